@@ -0,0 +1,703 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <algorithm>
+#include <numeric>
+#include <limits>
+#include <charconv>
+#include <cstdint>
+#include "aggregate.h"
+#include "keys.h"
+#include "stats.h"
+using namespace std;
+
+
+static const int BatchSize = 1024;  // records aggregated at a time
+static const int Lanes = 8;         // independent partial results of foldBatch
+static const uint32_t NoGroup = UINT32_MAX;
+
+
+// running count, sum, min and max of one column's numbers
+template<typename T>
+struct accumulator {
+
+	int64_t Count;
+	T       Sum, Min, Max;
+
+	accumulator() : Count(0), Sum(0) {
+
+		Min = numeric_limits<T>::has_infinity ? numeric_limits<T>::infinity() : numeric_limits<T>::max();
+		Max = numeric_limits<T>::has_infinity ? -numeric_limits<T>::infinity() : numeric_limits<T>::lowest();
+
+	}
+
+	// count copies of value, e.g. an index key with count records
+	void add(T value, int64_t count) {
+
+		Count += count;
+		Sum += value * (T) count;
+		Min = min(Min, value);
+		Max = max(Max, value);
+
+	}
+
+};
+
+
+// running count, min and max of a string column's values, as views of
+// them in the mapped .data or .col file, or in an index
+struct textrange {
+
+	int64_t     Count;
+	string_view Min, Max;
+
+	textrange() : Count(0) {}
+
+	void add(string_view value, int64_t count) {
+
+		if (Count == 0 || value < Min) {
+			Min = value;
+		}
+		if (Count == 0 || value > Max) {
+			Max = value;
+		}
+		Count += count;
+
+	}
+
+};
+
+
+// folds n values into acc.  No branches, and Lanes partial sums,
+// minimums and maximums that don't depend on each other, so the loop
+// compiles to vector instructions: a running sum of doubles would make
+// each add wait on the last, as the compiler may not reorder them.
+template<typename T>
+static void foldBatch(const T* values, int n, accumulator<T>& acc) {
+
+	T sum[Lanes], lo[Lanes], hi[Lanes];
+	for (int l = 0; l < Lanes; l++) {
+		sum[l] = 0;
+		lo[l] = acc.Min;
+		hi[l] = acc.Max;
+	}
+
+	int i = 0;
+	for (; i + Lanes <= n; i += Lanes) {
+		for (int l = 0; l < Lanes; l++) {
+			T value = values[i + l];
+			sum[l] += value;
+			lo[l] = (value < lo[l]) ? value : lo[l];
+			hi[l] = (value > hi[l]) ? value : hi[l];
+		}
+	}
+	for (; i < n; i++) {
+		T value = values[i];
+		sum[0] += value;
+		lo[0] = (value < lo[0]) ? value : lo[0];
+		hi[0] = (value > hi[0]) ? value : hi[0];
+	}
+
+	for (int l = 0; l < Lanes; l++) {
+		acc.Sum += sum[l];
+		acc.Min = min(acc.Min, lo[l]);
+		acc.Max = max(acc.Max, hi[l]);
+	}
+	acc.Count += n;
+
+}
+
+
+// shortest text that reads back as value
+static string formatNumber(double value) {
+
+	char text[32];
+	to_chars_result result = to_chars(text, text + sizeof(text), value);
+	return string(text, result.ptr);
+
+}
+
+
+// the aggregates of one group, or of the whole query if it isn't grouped
+struct groupstate {
+
+	int64_t Rows;  // count(*)
+	vector<accumulator<int64_t>> Ints;
+	vector<accumulator<double>>  Doubles;
+	vector<textrange>            Texts;
+
+	groupstate() : Rows(0) {}
+
+};
+
+
+// Evaluates one aggregate query.  Each column the aggregates read has a
+// slot: a batch array of its values, and an accumulator of its type in
+// every group.
+class aggregator {
+
+private:
+
+	struct SLOT {
+		int Column;
+		int Type;   // the column's type (columnfile::String, Int, Double)
+		int Index;  // of its accumulator in a groupstate's Ints, Doubles or Texts
+	};
+
+	const dbtable& Table;
+	const query&   Q;
+	vector<SLOT>   Slots;
+	vector<int>    AggregateSlot;  // for each aggregate, its slot; -1 for count(*)
+	int            GroupType;
+
+	groupstate         Empty;   // a group before anything is added to it
+	vector<groupstate> Groups;  // by group id; just one if the query isn't grouped
+	unordered_map<string_view, uint32_t> TextGroups;  // group key -> group id
+	unordered_map<int64_t, uint32_t>     IntGroups;
+	unordered_map<double, uint32_t>      DoubleGroups;
+	vector<string_view> TextKeys;  // group id -> group key
+	vector<int64_t>     IntKeys;
+	vector<double>      DoubleKeys;
+	vector<uint32_t>    CodeGroups;  // .col string group column: code -> group id
+
+	// the batch: for each slot, its values (in IntBatch, DoubleBatch or
+	// TextBatch, or the .col file's arrays).  Grouped, value i is record
+	// i's, if Selected; else they are packed, Counts of them, so
+	// foldBatch needs no mask.
+	vector<const void*>    Values;
+	vector<const uint8_t*> Selected;
+	vector<int>            Counts;
+	vector<int64_t>     IntBatch;
+	vector<double>      DoubleBatch;
+	vector<string_view> TextBatch;
+	vector<uint8_t>     SelectedBatch;
+	vector<uint8_t>     RowSelected;  // record is counted
+	vector<uint32_t>    GroupIds;     // record's group, NoGroup if it has none
+	vector<streamoff>   Rows;         // record's position, or row # in the .col file
+
+	template<typename TKey>
+	uint32_t _group(unordered_map<TKey, uint32_t>& groups, vector<TKey>& keys, TKey key);
+	uint32_t _groupOf(string_view value);
+	void _fold(int n);
+
+public:
+
+	aggregator(const dbtable& table, const query& q);
+
+	void fromCount();
+	void fromIndex();
+	void fromColumns(const vector<streamoff>* positions);
+	void fromData(const vector<streamoff>* positions);
+	void print(ostream& out);
+
+};
+
+
+aggregator::aggregator(const dbtable& table, const query& q) : Table(table), Q(q) {
+
+	for (const aggregate& agg : q.Aggregates) {
+		int slot = -1;
+		for (unsigned s = 0; s < Slots.size(); s++) {
+			if (Slots[s].Column == agg.Column) {
+				slot = s;
+			}
+		}
+		if (agg.Column >= 0 && slot < 0) {
+			SLOT added;
+			added.Column = agg.Column;
+			added.Type = table.columnTypes()[agg.Column];
+			if (added.Type == columnfile::Int) {
+				added.Index = Empty.Ints.size();
+				Empty.Ints.emplace_back();
+			}
+			else if (added.Type == columnfile::Double) {
+				added.Index = Empty.Doubles.size();
+				Empty.Doubles.emplace_back();
+			}
+			else {
+				added.Index = Empty.Texts.size();
+				Empty.Texts.emplace_back();
+			}
+			slot = Slots.size();
+			Slots.push_back(added);
+		}
+		AggregateSlot.push_back(slot);
+	}
+	GroupType = (q.GroupColumn >= 0) ? table.columnTypes()[q.GroupColumn] : columnfile::String;
+	if (q.GroupColumn < 0) {
+		Groups.push_back(Empty);
+	}
+
+	// sized once, so batches don't allocate
+	Values.resize(Slots.size());
+	Selected.resize(Slots.size());
+	Counts.resize(Slots.size());
+	IntBatch.resize(Empty.Ints.size() * BatchSize);
+	DoubleBatch.resize(Empty.Doubles.size() * BatchSize);
+	TextBatch.resize(Empty.Texts.size() * BatchSize);
+	SelectedBatch.resize(Slots.size() * BatchSize);
+	RowSelected.resize(BatchSize);
+	GroupIds.resize(BatchSize);
+	Rows.resize(BatchSize);
+
+}
+
+
+// id of the group with the given key, starting the group if it's new
+template<typename TKey>
+uint32_t aggregator::_group(unordered_map<TKey, uint32_t>& groups, vector<TKey>& keys, TKey key) {
+
+	auto found = groups.find(key);
+	if (found != groups.end()) {
+		return found->second;
+	}
+	uint32_t id = Groups.size();
+	groups.emplace(key, id);
+	keys.push_back(key);
+	Groups.push_back(Empty);
+	return id;
+
+}
+
+
+// id of the group of a group column value; NoGroup if it isn't a value
+// of the column's type
+uint32_t aggregator::_groupOf(string_view value) {
+
+	if (GroupType == columnfile::Int) {
+		int64_t key;
+		return ParseKey(value, key) ? _group(IntGroups, IntKeys, key) : NoGroup;
+	}
+	else if (GroupType == columnfile::Double) {
+		double key;
+		return ParseKey(value, key) ? _group(DoubleGroups, DoubleKeys, key) : NoGroup;
+	}
+	return value.empty() ? NoGroup : _group(TextGroups, TextKeys, value);
+
+}
+
+
+// adds the first n records of the batch to their groups.  Ungrouped,
+// each slot's values are folded in with one call to foldBatch.
+void aggregator::_fold(int n) {
+
+	if (Q.GroupColumn < 0) {
+		groupstate& group = Groups[0];
+		int64_t rows = 0;
+		for (int i = 0; i < n; i++) {
+			rows += RowSelected[i];
+		}
+		group.Rows += rows;
+		for (unsigned s = 0; s < Slots.size(); s++) {
+			const SLOT& slot = Slots[s];
+			if (slot.Type == columnfile::Int) {
+				foldBatch((const int64_t*) Values[s], Counts[s], group.Ints[slot.Index]);
+			}
+			else if (slot.Type == columnfile::Double) {
+				foldBatch((const double*) Values[s], Counts[s], group.Doubles[slot.Index]);
+			}
+			else {
+				const string_view* texts = (const string_view*) Values[s];
+				for (int i = 0; i < Counts[s]; i++) {
+					group.Texts[slot.Index].add(texts[i], 1);
+				}
+			}
+		}
+		return;
+	}
+
+	for (int i = 0; i < n; i++) {
+		if (!RowSelected[i] || GroupIds[i] == NoGroup) {
+			continue;
+		}
+		groupstate& group = Groups[GroupIds[i]];
+		group.Rows++;
+		for (unsigned s = 0; s < Slots.size(); s++) {
+			const SLOT& slot = Slots[s];
+			if (!Selected[s][i]) {
+				continue;
+			}
+			if (slot.Type == columnfile::Int) {
+				group.Ints[slot.Index].add(((const int64_t*) Values[s])[i], 1);
+			}
+			else if (slot.Type == columnfile::Double) {
+				group.Doubles[slot.Index].add(((const double*) Values[s])[i], 1);
+			}
+			else {
+				group.Texts[slot.Index].add(((const string_view*) Values[s])[i], 1);
+			}
+		}
+	}
+
+}
+
+
+// count(*) of every record: the records in the file, less the deleted
+void aggregator::fromCount() {
+
+	int64_t recordSize = Table.recordSize();
+	int64_t numRecords = (recordSize > 0) ? (Table.data().length() + recordSize - 1) / recordSize : 0;
+	Groups[0].Rows = numRecords - Table.numDeleted();
+
+}
+
+
+// from the frozen avl index of the one column the query reads: each key
+// in the where clause's range (all of them without one) is a value that
+// count records have
+void aggregator::fromIndex() {
+
+	int column = Q.WhereColumn;
+	for (const aggregate& agg : Q.Aggregates) {
+		column = max(column, agg.Column);
+	}
+	column = max(column, Q.GroupColumn);
+	const flatindex& index = Table.flatVector()[Table.columnIndex(column)];
+	int type = Table.columnTypes()[column];
+
+	size_t first = 0, last = index.size();
+	if (Q.WhereColumn >= 0) {
+		IndexRange(index, Q.Where, first, last);
+	}
+	for (size_t rank = first; rank < last; rank++) {
+		int64_t count = index.positions(rank).size();
+		string_view bytes = index.key(rank);
+		int64_t intKey = 0;
+		double doubleKey = 0;
+		if (type == columnfile::Int) {
+			DecodeKey(bytes, intKey);
+		}
+		else if (type == columnfile::Double) {
+			DecodeKey(bytes, doubleKey);
+		}
+
+		uint32_t id = 0;
+		if (Q.GroupColumn >= 0) {
+			id = (type == columnfile::Int) ? _group(IntGroups, IntKeys, intKey) :
+				(type == columnfile::Double) ? _group(DoubleGroups, DoubleKeys, doubleKey) :
+				_group(TextGroups, TextKeys, bytes);
+		}
+		groupstate& group = Groups[id];
+		group.Rows += count;
+		for (const SLOT& slot : Slots) {
+			if (type == columnfile::Int) {
+				group.Ints[slot.Index].add(intKey, count);
+			}
+			else if (type == columnfile::Double) {
+				group.Doubles[slot.Index].add(doubleKey, count);
+			}
+			else {
+				group.Texts[slot.Index].add(bytes, count);
+			}
+		}
+	}
+	CountStat(&querystats::NodesVisited, last - first);
+
+}
+
+
+// from the .col file: the records at positions, else every record.
+// Every record's numbers are folded straight from the column arrays.
+void aggregator::fromColumns(const vector<streamoff>* positions) {
+
+	const columnfile& columns = Table.columns();
+	const datafile& data = Table.data();
+	int recordSize = Table.recordSize();
+	bool grouped = Q.GroupColumn >= 0;
+	bool every = positions == nullptr && Table.numDeleted() == 0; // every row of the arrays
+	int64_t total = (positions != nullptr) ? positions->size() : columns.numRows();
+	CountStat((positions != nullptr) ? &querystats::RecordsFetched : &querystats::RecordsScanned, total);
+	CountStat(&querystats::BytesRead, total * 8 * (int64_t) (Slots.size() + grouped));
+
+	for (int64_t first = 0; first < total; first += BatchSize) {
+		int n = (int) min<int64_t>(BatchSize, total - first);
+		if (positions != nullptr) {
+			for (int i = 0; i < n; i++) {
+				Rows[i] = (*positions)[first + i] / recordSize;
+			}
+		}
+		else {
+			iota(Rows.begin(), Rows.begin() + n, first);
+		}
+		if (positions != nullptr || Table.numDeleted() == 0) {
+			fill(RowSelected.begin(), RowSelected.begin() + n, 1);
+		}
+		else { // the .col file still has the records deleted since it was made
+			for (int i = 0; i < n; i++) {
+				RowSelected[i] = !data.deleted(Rows[i] * recordSize);
+			}
+		}
+
+		for (unsigned s = 0; s < Slots.size(); s++) {
+			const SLOT& slot = Slots[s];
+			Selected[s] = RowSelected.data();
+			if (every && slot.Type == columnfile::Int) {
+				Values[s] = columns.ints(slot.Column) + first;
+				Counts[s] = n;
+				continue;
+			}
+			else if (every && slot.Type == columnfile::Double) {
+				Values[s] = columns.doubles(slot.Column) + first;
+				Counts[s] = n;
+				continue;
+			}
+
+			int64_t* ints = IntBatch.data() + slot.Index * BatchSize;
+			double* doubles = DoubleBatch.data() + slot.Index * BatchSize;
+			string_view* texts = TextBatch.data() + slot.Index * BatchSize;
+			int count = 0;
+			for (int i = 0; i < n; i++) {
+				int at = grouped ? i : count;
+				if (slot.Type == columnfile::Int) {
+					ints[at] = columns.ints(slot.Column)[Rows[i]];
+				}
+				else if (slot.Type == columnfile::Double) {
+					doubles[at] = columns.doubles(slot.Column)[Rows[i]];
+				}
+				else {
+					texts[at] = columns.dictValue(slot.Column, columns.codes(slot.Column)[Rows[i]]);
+				}
+				count += RowSelected[i];
+			}
+			Values[s] = (slot.Type == columnfile::Int) ? (const void*) ints :
+				(slot.Type == columnfile::Double) ? (const void*) doubles : (const void*) texts;
+			Counts[s] = count;
+		}
+
+		if (grouped) {
+			int column = Q.GroupColumn;
+			for (int i = 0; i < n; i++) {
+				if (!RowSelected[i]) { // deleted: no group of its own, if its value's other records are too
+					GroupIds[i] = NoGroup;
+				}
+				else if (GroupType == columnfile::Int) {
+					GroupIds[i] = _group(IntGroups, IntKeys, columns.ints(column)[Rows[i]]);
+				}
+				else if (GroupType == columnfile::Double) {
+					GroupIds[i] = _group(DoubleGroups, DoubleKeys, columns.doubles(column)[Rows[i]]);
+				}
+				else { // a group per dictionary code
+					uint32_t code = columns.codes(column)[Rows[i]];
+					if (CodeGroups.empty()) {
+						CodeGroups.assign(columns.dictSize(column), NoGroup);
+					}
+					if (CodeGroups[code] == NoGroup) {
+						CodeGroups[code] = _group(TextGroups, TextKeys, columns.dictValue(column, code));
+					}
+					GroupIds[i] = CodeGroups[code];
+				}
+			}
+		}
+		_fold(n);
+	}
+
+}
+
+
+// from the .data file: the records at positions, else every record.
+// A value that isn't a number in a number column is left out.
+void aggregator::fromData(const vector<streamoff>* positions) {
+
+	const datafile& data = Table.data();
+	int recordSize = Table.recordSize();
+	bool grouped = Q.GroupColumn >= 0;
+	int64_t total = (positions != nullptr) ? positions->size() :
+		(recordSize > 0) ? (data.length() + recordSize - 1) / recordSize : 0;
+	CountStat((positions != nullptr) ? &querystats::RecordsFetched : &querystats::RecordsScanned, total);
+	CountStat(&querystats::BytesRead, total * recordSize);
+
+	int64_t next = 0;
+	while (next < total) {
+		int n = 0;
+		for (; next < total && n < BatchSize; next++) {
+			streamoff pos = (positions != nullptr) ? (*positions)[next] : next * recordSize;
+			if (positions == nullptr && data.deleted(pos)) {
+				continue;
+			}
+			Rows[n] = pos;
+			RowSelected[n] = 1;
+			n++;
+		}
+
+		for (unsigned s = 0; s < Slots.size(); s++) {
+			const SLOT& slot = Slots[s];
+			uint8_t* selected = SelectedBatch.data() + s * BatchSize;
+			int64_t* ints = IntBatch.data() + slot.Index * BatchSize;
+			double* doubles = DoubleBatch.data() + slot.Index * BatchSize;
+			string_view* texts = TextBatch.data() + slot.Index * BatchSize;
+			int count = 0;
+			for (int i = 0; i < n; i++) {
+				streamoff end = min<streamoff>(Rows[i] + recordSize, data.length());
+				string_view value = FieldAt(data.data(), Rows[i], end, slot.Column);
+				int at = grouped ? i : count;
+				if (slot.Type == columnfile::Int) {
+					selected[i] = ParseKey(value, ints[at]);
+				}
+				else if (slot.Type == columnfile::Double) {
+					selected[i] = ParseKey(value, doubles[at]);
+				}
+				else {
+					selected[i] = !value.empty();
+					texts[at] = value;
+				}
+				count += selected[i];
+			}
+			Values[s] = (slot.Type == columnfile::Int) ? (const void*) ints :
+				(slot.Type == columnfile::Double) ? (const void*) doubles : (const void*) texts;
+			Selected[s] = selected;
+			Counts[s] = count;
+		}
+
+		if (grouped) {
+			for (int i = 0; i < n; i++) {
+				streamoff end = min<streamoff>(Rows[i] + recordSize, data.length());
+				GroupIds[i] = _groupOf(FieldAt(data.data(), Rows[i], end, Q.GroupColumn));
+			}
+		}
+		_fold(n);
+	}
+
+}
+
+
+void aggregator::print(ostream& out) {
+
+	if (Groups.empty()) {
+		out << "Not found..."
+		<< '\n';
+		return;
+	}
+
+	// groups in the group column's order
+	vector<uint32_t> order(Groups.size());
+	iota(order.begin(), order.end(), 0);
+	if (Q.GroupColumn >= 0) {
+		sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+			return (GroupType == columnfile::Int) ? IntKeys[a] < IntKeys[b] :
+				(GroupType == columnfile::Double) ? DoubleKeys[a] < DoubleKeys[b] : TextKeys[a] < TextKeys[b];
+		});
+	}
+
+	for (uint32_t id : order) {
+		const groupstate& group = Groups[id];
+		if (Q.GroupColumn >= 0) {
+			out << Table.columnVector()[Q.GroupColumn]
+			<< ": ";
+			if (GroupType == columnfile::Int) {
+				out << IntKeys[id];
+			}
+			else if (GroupType == columnfile::Double) {
+				out << formatNumber(DoubleKeys[id]);
+			}
+			else {
+				out << TextKeys[id];
+			}
+			out << '\n';
+		}
+
+		for (unsigned k = 0; k < Q.Aggregates.size(); k++) {
+			const aggregate& agg = Q.Aggregates[k];
+			out << agg.Name
+			<< ": ";
+			if (agg.Function == aggregate::Count) {
+				out << group.Rows;
+			}
+			else if (Slots[AggregateSlot[k]].Type == columnfile::Int) {
+				const accumulator<int64_t>& acc = group.Ints[Slots[AggregateSlot[k]].Index];
+				if (acc.Count == 0) {
+					out << "null";
+				}
+				else if (agg.Function == aggregate::Avg) {
+					out << formatNumber((double) acc.Sum / acc.Count);
+				}
+				else {
+					out << (agg.Function == aggregate::Sum ? acc.Sum : agg.Function == aggregate::Min ? acc.Min : acc.Max);
+				}
+			}
+			else if (Slots[AggregateSlot[k]].Type == columnfile::Double) {
+				const accumulator<double>& acc = group.Doubles[Slots[AggregateSlot[k]].Index];
+				if (acc.Count == 0) {
+					out << "null";
+				}
+				else {
+					out << formatNumber(agg.Function == aggregate::Sum ? acc.Sum : agg.Function == aggregate::Avg ?
+						acc.Sum / acc.Count : agg.Function == aggregate::Min ? acc.Min : acc.Max);
+				}
+			}
+			else {
+				const textrange& range = group.Texts[Slots[AggregateSlot[k]].Index];
+				if (range.Count == 0) {
+					out << "null";
+				}
+				else {
+					out << (agg.Function == aggregate::Min ? range.Min : range.Max);
+				}
+			}
+			out << '\n';
+		}
+	}
+
+}
+
+
+int AggregateSource(const dbtable& table, const query& q) {
+
+	// the one column the query reads, if it reads just one
+	int column = -1;
+	bool single = true;
+	auto reads = [&](int c) {
+		if (c >= 0) {
+			single = single && (column < 0 || column == c);
+			column = c;
+		}
+	};
+	for (const aggregate& agg : q.Aggregates) {
+		reads(agg.Column);
+	}
+	reads(q.WhereColumn);
+	for (const term& t : q.Terms) {
+		reads(t.Column);
+	}
+	reads(q.GroupColumn);
+
+	if (column < 0) {
+		return AggregateFromCount;
+	}
+	int index = table.columnIndex(column);
+	if (single && index >= 0 && table.indexKind(index) == "avl" && !table.indexStale(index) &&
+			(q.WhereColumn < 0 || q.Path == query::FlatIndex)) {
+		return AggregateFromIndex;
+	}
+	return table.columns().isOpen() ? AggregateFromColumns : AggregateFromData;
+
+}
+
+
+void AggregateRecords(const dbtable& table, const query& q, ostream& out) {
+
+	aggregator result(table, q);
+	int source = AggregateSource(table, q);
+	if (source == AggregateFromCount) {
+		result.fromCount();
+	}
+	else if (source == AggregateFromIndex) {
+		result.fromIndex();
+	}
+	else {
+		vector<streamoff> dataPosVector;
+		if (q.WhereColumn >= 0) {
+			dataPosVector = FindRecords(table, q);
+		}
+		const vector<streamoff>* positions = (q.WhereColumn >= 0) ? &dataPosVector : nullptr;
+		if (source == AggregateFromColumns) {
+			result.fromColumns(positions);
+		}
+		else {
+			result.fromData(positions);
+		}
+	}
+	result.print(out);
+
+}
@@ -0,0 +1,40 @@
+#ifndef AGGREGATE_H
+#define AGGREGATE_H
+
+#include <iostream>
+#include "table.h"
+#include "query.h"
+using namespace std;
+
+
+// Aggregate queries: count(*), sum, avg, min and max, over all of a
+// table's records or those matching a where clause, and optionally
+// grouped by a column.  Where an aggregate query's values come from,
+// cheapest first:
+//   AggregateFromCount    the table's record count, for count(*) alone
+//   AggregateFromIndex    an avl index's keys and how many records each
+//                         has, if every column the query reads is that
+//                         index's column --- no record is read
+//   AggregateFromColumns  the typed arrays of the .col file
+//   AggregateFromData     the values of the .data file
+// The last two read the records (the where clause's matches, else every
+// record) a batch of 1024 at a time into flat arrays of numbers, then
+// fold each array into its sum, min and max in one branch-free pass.
+const int AggregateFromCount = 0;
+const int AggregateFromIndex = 1;
+const int AggregateFromColumns = 2;
+const int AggregateFromData = 3;
+
+
+// which of the sources above answers a parsed aggregate query
+int AggregateSource(const dbtable& table, const query& q);
+
+
+// evaluates a parsed aggregate query and prints one "aggregate: value"
+// line per aggregate, as written in the query, e.g. "avg(latitude): 41.8".
+// Grouped, each group is "column: value" followed by its aggregates,
+// in the column's order, and "Not found..." if there are none.  A sum,
+// avg, min or max of no values is "null".
+void AggregateRecords(const dbtable& table, const query& q, ostream& out);
+
+#endif
@@ -1,13 +1,21 @@
+#ifndef AVL_H
+#define AVL_H
+
 #include <iostream>
 #include <algorithm>  // std::max
 #include <cstdlib>    // std::abs
 #include <stack>
 #include <vector>
+#include <utility>    // std::pair
 #include <cassert>
+#include <type_traits>
+#include "slabpool.h"
+#include "stats.h"
 using namespace std;
-template<typename TKey, typename TValue>
+template<typename TKey, typename TValue, template<typename> class TPool = slabpool>
 
 // AVL Tree Class Implementation...
+// TPool is the node storage policy, see slabpool.h.
 class avltree {
 
 private:
@@ -22,6 +30,15 @@ private:
 
 	NODE* Root;  // pointer to root node of tree (nullptr if empty)
 	int   Size;  // # of nodes in the tree (0 if empty)
+	TPool<NODE> Pool;  // storage for the nodes
+
+	
+	// Constructs a new node in storage from the pool.
+	NODE* _newnode() {
+
+		return new (Pool.allocate()) NODE();
+
+	}
 
 	
 	// Helper function to make a full copy of tree. Calls 
@@ -41,7 +58,8 @@ private:
 
 	// Helper function for destructor to recurse till leafs of
 	// tree to then delete the node. In other words, deletes
-	// the tree in postorder fashion.
+	// the tree in postorder fashion. If the pool frees all
+	// its storage at once, nodes are only destroyed here.
 	void _deletebinarysearchtree(NODE* cur) {
 
 		if (cur == nullptr) {
@@ -49,11 +67,27 @@ private:
 		}
 		_deletebinarysearchtree(cur->Left);
 		_deletebinarysearchtree(cur->Right);
-		delete cur; // Delete very last node in tree.
+		cur->~NODE(); // Delete very last node in tree.
+		if (!TPool<NODE>::ReleasesAll) {
+			Pool.deallocate(cur);
+		}
 
   	}
 
 
+	// Deletes every node. Walking the tree is skipped entirely
+	// when the nodes need no destructor and the pool can hand
+	// back whole slabs.
+	void _deleteall() {
+
+		if (!std::is_trivially_destructible<NODE>::value || !TPool<NODE>::ReleasesAll) {
+			_deletebinarysearchtree(Root);
+		}
+		Pool.release();
+
+	}
+
+
 	// Helper function to print tree inorder. Recurses till 
 	// end of left most node, then prints, then recurses
 	// back to parent node, prints, then recurses to right node
@@ -197,8 +231,9 @@ private:
 			
 			int hL = (Pivot->Left->Left == nullptr) ? -1 : Pivot->Left->Left->Height;
 			int hR = (Pivot->Left->Right == nullptr) ? -1 : Pivot->Left->Right->Height;
-			// Check if conditions for right rotate are met.
-			if (hL > hR) {
+			// Check if conditions for right rotate are met. Equal
+			// heights only happen after a remove; one rotation fixes it.
+			if (hL >= hR) {
 				_RightRotate(Parent, Pivot);
 			}
 			else {
@@ -212,7 +247,7 @@ private:
 			int hL = (Pivot->Right->Left == nullptr) ? -1 : Pivot->Right->Left->Height;
 			int hR = (Pivot->Right->Right == nullptr) ? -1 : Pivot->Right->Right->Height;
 			// Check if conditions for left rotate are met.
-			if (hL < hR) {
+			if (hL <= hR) {
 				_LeftRotate(Parent, Pivot);
 			}
 			else {
@@ -225,6 +260,29 @@ private:
 	}
 
 
+	// Helper function for bulkload. Makes the middle pair the
+	// root of the subtree and recurses on each half, so the
+	// tree comes out perfectly balanced. Heights are set on
+	// the way back up.
+	NODE* _bulkbuild(vector<pair<TKey, TValue>>& pairs, size_t lo, size_t hi) {
+
+		if (lo >= hi) {
+			return nullptr;
+		}
+		size_t mid = lo + (hi - lo) / 2;
+		NODE* newNode = _newnode();
+		newNode->Key = std::move(pairs[mid].first);
+		newNode->Value = std::move(pairs[mid].second);
+		newNode->Left = _bulkbuild(pairs, lo, mid);
+		newNode->Right = _bulkbuild(pairs, mid + 1, hi);
+		int hL = (newNode->Left == nullptr) ? -1 : newNode->Left->Height;
+		int hR = (newNode->Right == nullptr) ? -1 : newNode->Right->Height;
+		newNode->Height = 1 + std::max(hL, hR);
+		return newNode;
+
+	}
+
+
 	// For test.cpp file to test cases
 	void _inorder_keys(NODE* cur, std::vector<TKey>& V) {
 		
@@ -272,6 +330,68 @@ private:
 
 public:
 
+	typedef TKey key_type;
+
+	// Inorder iterator over a tree, without recursion. The
+	// path from the root down to the current node is kept in
+	// a fixed array (an AVL tree with 2^31 nodes is less than
+	// 45 high), so iterating never allocates. Only valid until
+	// the tree is next changed.
+	class iterator {
+
+	private:
+
+		friend class avltree;
+		static const int MaxDepth = 64;
+
+		// Ancestors still to visit; the top is the current node.
+		const NODE* Path[MaxDepth];
+		int Depth;
+
+
+		// Pushes cur and its chain of left children, so the
+		// smallest key under cur ends up on top.
+		void _pushleft(const NODE* cur) {
+
+			while (cur != nullptr) {
+				assert(Depth < MaxDepth);
+				Path[Depth++] = cur;
+				cur = cur->Left;
+			}
+
+		}
+
+	public:
+
+		iterator() {	Depth = 0;	}
+
+		const TKey& key() const       {	return Path[Depth - 1]->Key;	}
+		const TValue& value() const   {	return Path[Depth - 1]->Value;	}
+
+		// Moves to the next larger key: the leftmost node of the
+		// right subtree, or else the nearest pending ancestor.
+		iterator& operator++() {
+
+			const NODE* cur = Path[--Depth];
+			_pushleft(cur->Right);
+			return *this;
+
+		}
+
+		bool operator==(const iterator& other) const {
+
+			if (Depth == 0 || other.Depth == 0) {
+				return Depth == other.Depth;
+			}
+			return Path[Depth - 1] == other.Path[other.Depth - 1];
+
+		}
+
+		bool operator!=(const iterator& other) const {	return !(*this == other);	}
+
+	};
+
+
 	// Initializes class variables.
 	avltree() {
 
@@ -298,11 +418,34 @@ public:
 	}
 
 
+	// Builds a balanced tree directly from key/value pairs,
+	// see bulkload.
+	explicit avltree(vector<pair<TKey, TValue>> pairs) {
+
+		Root = nullptr;
+		Size = 0;
+		bulkload(pairs);
+
+	}
+
+
+	// Takes over the other tree's nodes without copying them,
+	// leaving the other tree empty.
+	avltree(avltree&& other) noexcept : Pool(std::move(other.Pool)) {
+
+		Root = other.Root;
+		Size = other.Size;
+		other.Root = nullptr;
+		other.Size = 0;
+
+	}
+
+
 	// Calls helper function to delete entire tree using
 	// postorder. Then resets Root to nullptr.
 	virtual ~avltree() {
 
-		_deletebinarysearchtree(Root);
+		_deleteall();
 		Root = nullptr;
 
 	}
@@ -318,12 +461,29 @@ public:
 	}
 
 
+	// Deletes this tree, then takes over the other tree's nodes
+	// without copying them, leaving the other tree empty.
+	avltree& operator=(avltree&& other) noexcept {
+
+		if (this != &other) {
+			clear();
+			Pool = std::move(other.Pool);
+			Root = other.Root;
+			Size = other.Size;
+			other.Root = nullptr;
+			other.Size = 0;
+		}
+		return *this;
+
+	}
+
+
 	// Getter function to return Size class variable.
-	int size() {	return Size;	}
+	int size() const {	return Size;	}
 
 
 	// Calls helper function _height and passes the root of tree.
-	int height() {	
+	int height() const {	
 
 		if (Root == nullptr) {
 			return -1;
@@ -339,20 +499,31 @@ public:
 	// Then resets Root pointer and Size.
 	void clear() {
 
-		_deletebinarysearchtree(Root);
+		_deleteall();
 		Root = nullptr;
 		Size = 0;
 
 	}
 
 
+	// Same as search below, for read-only trees.
+	const TValue* search(const TKey& key) const {
+
+		return const_cast<avltree*>(this)->search(key);
+
+	}
+
+
 	// Traverses tree until key is found, then returns.
 	// If not found, return nullptr.
-	TValue* search(TKey key) {
+	TValue* search(const TKey& key) {
 
 		NODE* temp = Root; // Temp node used to traverse.
+		int64_t visited = 0; // nodes looked at, for the query's stats
 		while (temp != nullptr) { // Loop till end of branch.
+			visited++;
 			if (temp->Key == key) {
+				CountStat(&querystats::NodesVisited, visited);
 				return &(temp->Value); // Return pointer to value to be read or written.
 			}
 			else if (key < temp->Key) { // Go left if key is less.
@@ -362,6 +533,7 @@ public:
 				temp = temp->Right;
 			}
 		}
+		CountStat(&querystats::NodesVisited, visited);
 		return nullptr; // Not found.
 
 	}
@@ -401,7 +573,7 @@ public:
 		}
 
 		// Create new node to be inserted.
-		NODE* newNode = new NODE();
+		NODE* newNode = _newnode();
 		newNode->Key = key;
 		newNode->Value = value;
 		newNode->Height = 0;
@@ -467,6 +639,170 @@ public:
 	}
 
 
+	// Finds the node with key, keeping the path to it on a
+	// stack. A node with two children takes over the key and
+	// value of its inorder successor, which is unlinked in its
+	// place; otherwise the node is replaced by its only child.
+	// Then goes back up the stack updating heights and calling
+	// rotateToFix where the avl height condition is broken.
+	// Unlike insert, more than one rotation may be needed.
+	// Returns false if key is not in the tree.
+	bool remove(const TKey& key) {
+
+		NODE* cur = Root;
+		stack<NODE*> nodes;
+
+		// Search for the node to remove.
+		while (cur != nullptr && !(key == cur->Key)) {
+			nodes.push(cur);
+			cur = (key < cur->Key) ? cur->Left : cur->Right;
+		}
+		if (cur == nullptr) {
+			return false;
+		}
+
+		// Two children: the successor is the leftmost node of the
+		// right subtree; it moves up and its own node goes instead.
+		NODE* victim = cur;
+		if (cur->Left != nullptr && cur->Right != nullptr) {
+			nodes.push(cur);
+			victim = cur->Right;
+			while (victim->Left != nullptr) {
+				nodes.push(victim);
+				victim = victim->Left;
+			}
+			std::swap(cur->Key, victim->Key);
+			std::swap(cur->Value, victim->Value);
+		}
+
+		// victim has at most one child, which takes its place.
+		NODE* child = (victim->Left != nullptr) ? victim->Left : victim->Right;
+		NODE* parent = nodes.empty() ? nullptr : nodes.top();
+		if (parent == nullptr) {
+			Root = child;
+		}
+		else if (parent->Left == victim) {
+			parent->Left = child;
+		}
+		else {
+			parent->Right = child;
+		}
+		victim->~NODE();
+		Pool.deallocate(victim);
+		Size--;
+
+		// Walk back up tree using stack and update heights.
+		while (!nodes.empty()) {
+
+			cur = nodes.top();
+			nodes.pop();
+			int HL = (cur->Left == nullptr) ? -1 : cur->Left->Height;
+			int HR = (cur->Right == nullptr) ? -1 : cur->Right->Height;
+			cur->Height = 1 + max(HL, HR);
+
+			if (abs(HL - HR) > 1) { // Node broken.
+				NODE* Parent = nodes.empty() ? nullptr : nodes.top();
+				_rotateToFix(Parent, cur);
+			}
+
+		}
+		return true;
+
+	}
+
+
+	// Calls fn on every value, inorder, so values can be changed
+	// in place; keys are left alone, so the order is kept.
+	template<typename Fn>
+	void transform_values(Fn fn) {
+
+		stack<NODE*> nodes;
+		NODE* cur = Root;
+		while (cur != nullptr || !nodes.empty()) {
+			while (cur != nullptr) {
+				nodes.push(cur);
+				cur = cur->Left;
+			}
+			cur = nodes.top();
+			nodes.pop();
+			fn(cur->Value);
+			cur = cur->Right;
+		}
+
+	}
+
+
+	// Calls fn on every key, inorder, so keys can be changed in
+	// place.  fn must leave the keys in the same order, e.g. by
+	// only moving where a key's bytes are kept.
+	template<typename Fn>
+	void transform_keys(Fn fn) {
+
+		stack<NODE*> nodes;
+		NODE* cur = Root;
+		while (cur != nullptr || !nodes.empty()) {
+			while (cur != nullptr) {
+				nodes.push(cur);
+				cur = cur->Left;
+			}
+			cur = nodes.top();
+			nodes.pop();
+			fn(cur->Key);
+			cur = cur->Right;
+		}
+
+	}
+
+
+	// Returns the value for key, first inserting a default
+	// constructed value if the key is not in the tree yet.
+	// With a container value, such as a postinglist, this is
+	// how duplicate keys are added: emplace(key)->push_back(v).
+	TValue* emplace(const TKey& key) {
+
+		TValue* value = search(key);
+		if (value == nullptr) {
+			insert(key, TValue());
+			value = search(key);
+		}
+		return value;
+
+	}
+
+
+	// Replaces the contents of the tree with the given pairs in
+	// O(N) once sorted, instead of N inserts. Pairs are sorted
+	// by key if they aren't already; as with insert, only the
+	// first value given for a duplicate key is kept. The pairs
+	// are moved from, so the vector is left unspecified.
+	void bulkload(vector<pair<TKey, TValue>>& pairs) {
+
+		clear();
+		auto byKey = [](const pair<TKey, TValue>& a, const pair<TKey, TValue>& b) {
+			return a.first < b.first;
+		};
+		if (!is_sorted(pairs.begin(), pairs.end(), byKey)) {
+			stable_sort(pairs.begin(), pairs.end(), byKey); // stable, so first value of a key stays first
+		}
+
+		// Drop duplicate keys, keeping the first.
+		size_t unique = 0;
+		for (size_t i = 0; i < pairs.size(); i++) {
+			if (unique == 0 || pairs[unique - 1].first < pairs[i].first) {
+				if (unique != i) {
+					pairs[unique] = std::move(pairs[i]);
+				}
+				unique++;
+			}
+		}
+
+		Pool.reserve(unique); // one slab, laid out contiguously
+		Root = _bulkbuild(pairs, 0, unique);
+		Size = unique;
+
+	}
+
+
 	// Traverses through tree until split node is found 
 	// where both keys split direction. Then, two seperate
 	// while loops to loop in each direction to increment
@@ -542,6 +878,69 @@ public:
 	}
 
 
+	// Iterator to the smallest key.
+	iterator begin() const {
+
+		iterator it;
+		it._pushleft(Root);
+		return it;
+
+	}
+
+
+	// Iterator past the largest key.
+	iterator end() const {	return iterator();	}
+
+
+	// Iterator to the first key that is not less than key, or
+	// end() if there is none. Going left, a node is a candidate
+	// and stays on the path; going right, it is passed over.
+	iterator lower_bound(const TKey& key) const {
+
+		iterator it;
+		const NODE* cur = Root;
+		int64_t visited = 0;
+		while (cur != nullptr) {
+			visited++;
+			if (cur->Key < key) {
+				cur = cur->Right;
+			}
+			else {
+				assert(it.Depth < iterator::MaxDepth);
+				it.Path[it.Depth++] = cur;
+				cur = cur->Left;
+			}
+		}
+		CountStat(&querystats::NodesVisited, visited);
+		return it;
+
+	}
+
+
+	// Iterator to the first key that is greater than key, or
+	// end() if there is none.
+	iterator upper_bound(const TKey& key) const {
+
+		iterator it;
+		const NODE* cur = Root;
+		int64_t visited = 0;
+		while (cur != nullptr) {
+			visited++;
+			if (key < cur->Key) {
+				assert(it.Depth < iterator::MaxDepth);
+				it.Path[it.Depth++] = cur;
+				cur = cur->Left;
+			}
+			else {
+				cur = cur->Right;
+			}
+		}
+		CountStat(&querystats::NodesVisited, visited);
+		return it;
+
+	}
+
+
 	// Calls helper function to print the tree inorder.
 	void inorder() {
 
@@ -581,4 +980,6 @@ public:
 
 	}
 
-};
\ No newline at end of file
+};
+
+#endif
@@ -0,0 +1,915 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <random>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <cstdio>
+#include <thread>
+#include <sstream>
+#include <iomanip>
+#include <ctime>
+#include <cstdlib>
+#include <malloc.h>
+#include "avl.h"
+#include "util.h"
+#include "flatindex.h"
+#include "hashindex.h"
+#include "table.h"
+#include "query.h"
+#include "synthetic.h"
+using namespace std;
+
+
+// runs fn reps times and returns the fastest run in milliseconds.
+template<typename Fn>
+double timeIt(int reps, Fn fn) {
+
+	double best = 0;
+	for (int r = 0; r < reps; r++) {
+		auto start = chrono::steady_clock::now();
+		fn();
+		chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+		if (r == 0 || elapsed.count() < best) {
+			best = elapsed.count();
+		}
+	}
+	return best;
+
+}
+
+
+// one measurement: Items operations took Ms milliseconds
+struct benchresult {
+
+	string  Name;
+	int64_t Items;
+	double  Ms;
+
+};
+
+vector<benchresult> Results;
+string Filter;  // only run benchmark groups whose name contains this
+int NumErrors = 0;  // correctness checks that failed; main returns 1 if any did
+
+
+// prints a failed correctness check and counts it
+void checkFailed(const string& message) {
+
+	cout << "**Error: " << message << endl;
+	NumErrors++;
+
+}
+
+
+// true if the group of benchmarks called group should run
+bool selected(const string& group) {
+
+	return group.find(Filter) != string::npos;
+
+}
+
+
+// records a measurement and prints it, Google Benchmark style: time
+// per operation and operations per second.
+void report(const string& name, int64_t items, double ms) {
+
+	Results.push_back(benchresult{ name, items, ms });
+	cout << left << setw(40) << name << right
+	<< setw(12) << ms << " ms"
+	<< setw(12) << ms * 1e6 / max<int64_t>(1, items) << " ns/op"
+	<< setw(14) << items / (ms / 1000) << " ops/s"
+	<< endl;
+
+}
+
+
+// writes the results in Google Benchmark's JSON format, so existing
+// tools (e.g. its compare.py) can diff two runs
+bool writeJson(const string& filename) {
+
+	ofstream out(filename, ios::out | ios::trunc);
+	char date[32];
+	time_t now = time(nullptr);
+	strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+	out << "{\n";
+	out << "  \"context\": {\n";
+	out << "    \"date\": \"" << date << "\",\n";
+	out << "    \"num_cpus\": " << thread::hardware_concurrency() << ",\n";
+	out << "    \"library_build_type\": \"release\"\n";
+	out << "  },\n";
+	out << "  \"benchmarks\": [";
+	for (size_t i = 0; i < Results.size(); i++) {
+		const benchresult& result = Results[i];
+		double ns = result.Ms * 1e6 / max<int64_t>(1, result.Items);
+		out << (i == 0 ? "\n" : ",\n");
+		out << "    {\"name\": \"" << result.Name << "\", \"run_name\": \"" << result.Name << "\", "
+		<< "\"run_type\": \"iteration\", \"iterations\": " << result.Items << ", "
+		<< "\"real_time\": " << ns << ", \"cpu_time\": " << ns << ", \"time_unit\": \"ns\", "
+		<< "\"items_per_second\": " << result.Items / (result.Ms / 1000) << "}";
+	}
+	out << "\n  ]\n}\n";
+	return out.good();
+
+}
+
+
+// builds n random keys shaped like the id/name columns of the sample
+// tables, paired with the file position of a fixed size record.
+vector<pair<string, streamoff>> makePairs(int n, int recordSize) {
+
+	mt19937 rng(12345);
+	uniform_int_distribution<int> digit(0, 9);
+	vector<pair<string, streamoff>> pairs;
+	for (int i = 0; i < n; i++) {
+		string key = "station_";
+		for (int d = 0; d < 8; d++) {
+			key += (char) ('0' + digit(rng));
+		}
+		pairs.push_back(make_pair(key, (streamoff) i * recordSize));
+	}
+	return pairs;
+
+}
+
+
+// compares building an index with one insert per record against
+// collecting, sorting and bulk loading the same records.
+void benchBuild(int n) {
+
+	vector<pair<string, streamoff>> pairs = makePairs(n, 80);
+
+	double insertTime = timeIt(3, [&]() {
+		avltree<string, streamoff> tree;
+		for (size_t i = 0; i < pairs.size(); i++) {
+			tree.insert(pairs[i].first, pairs[i].second);
+		}
+	});
+	double bulkTime = timeIt(3, [&]() {
+		vector<pair<string, streamoff>> copy = pairs;
+		avltree<string, streamoff> tree;
+		tree.bulkload(copy);
+	});
+
+	report("build/insert_loop/" + to_string(n), n, insertTime);
+	report("build/bulkload/" + to_string(n), n, bulkTime);
+
+}
+
+
+// compares the node pools: per node heap allocation against slabs,
+// for building by inserts, searching every key, and tearing down.
+template<template<typename> class TPool>
+void benchPool(const char* name, vector<pair<string, streamoff>>& pairs) {
+
+	double buildTime = 0, searchTime = 0, clearTime = 0;
+	for (int r = 0; r < 3; r++) {
+		avltree<string, streamoff, TPool>* tree = new avltree<string, streamoff, TPool>();
+		double t = timeIt(1, [&]() {
+			for (size_t i = 0; i < pairs.size(); i++) {
+				tree->insert(pairs[i].first, pairs[i].second);
+			}
+		});
+		buildTime = (r == 0 || t < buildTime) ? t : buildTime;
+		long found = 0;
+		t = timeIt(1, [&]() {
+			for (size_t i = 0; i < pairs.size(); i++) {
+				found += (tree->search(pairs[i].first) != nullptr);
+			}
+		});
+		searchTime = (r == 0 || t < searchTime) ? t : searchTime;
+		t = timeIt(1, [&]() { delete tree; });
+		clearTime = (r == 0 || t < clearTime) ? t : clearTime;
+	}
+
+	string suffix = "/" + to_string(pairs.size());
+	report(string("pool/") + name + "/insert" + suffix, pairs.size(), buildTime);
+	report(string("pool/") + name + "/search" + suffix, pairs.size(), searchTime);
+	report(string("pool/") + name + "/teardown" + suffix, pairs.size(), clearTime);
+
+}
+
+
+// compares point lookups in an avl index against the same index
+// frozen into a flatindex, looking up every key in random order.
+void benchLookup(int n) {
+
+	vector<pair<string, streamoff>> pairs = makePairs(n, 80);
+	vector<pair<string, postinglist>> grouped;
+	for (size_t i = 0; i < pairs.size(); i++) {
+		grouped.push_back(make_pair(pairs[i].first, postinglist(pairs[i].second)));
+	}
+	avltree<string, postinglist> tree;
+	tree.bulkload(grouped);
+	flatindex flat;
+	flat.freeze(tree);
+	hashindex hash;
+	hash.build(tree);
+
+	vector<string> keys;
+	for (size_t i = 0; i < pairs.size(); i++) {
+		keys.push_back(pairs[i].first);
+	}
+	shuffle(keys.begin(), keys.end(), mt19937(42));
+
+	streamoff treeSum = 0, flatSum = 0, hashSum = 0;
+	double treeTime = timeIt(3, [&]() {
+		treeSum = 0;
+		for (const string& key : keys) {
+			treeSum += *tree.search(key)->begin();
+		}
+	});
+	double flatTime = timeIt(3, [&]() {
+		flatSum = 0;
+		for (const string& key : keys) {
+			flatSum += *flat.find(key).begin();
+		}
+	});
+	double hashTime = timeIt(3, [&]() {
+		hashSum = 0;
+		for (const string& key : keys) {
+			hashSum += *hash.find(key).begin();
+		}
+	});
+
+	report("lookup/avltree/" + to_string(n), keys.size(), treeTime);
+	report("lookup/flatindex/" + to_string(n), keys.size(), flatTime);
+	report("lookup/hashindex/" + to_string(n), keys.size(), hashTime);
+	if (treeSum != flatSum || treeSum != hashSum) {
+		checkFailed("lookup n=" + to_string(n) + " indexes disagree.");
+	}
+
+}
+
+
+// the same n distinct random numbers as keys of a string index (what every index
+// was before column types) and of an int64_t index: building each from
+// unsorted records, looking up every key, and a range of a tenth of the
+// keys.  Only the int index gets the range right, so it is also checked.
+void benchKeys(int n) {
+
+	mt19937_64 rng(12345);
+	uniform_int_distribution<int64_t> offset(0, 999);
+	vector<int64_t> numbers;
+	for (int i = 0; i < n; i++) {
+		numbers.push_back((int64_t) i * 1000 + offset(rng)); // distinct, of 3 to 9 digits
+	}
+	shuffle(numbers.begin(), numbers.end(), rng);
+	int64_t high = (int64_t) n * 100; // [0, high) holds a tenth of them
+
+	avltree<string, postinglist> stringTree;
+	avltree<int64_t, postinglist> intTree;
+	double stringBuild = timeIt(3, [&]() {
+		vector<pair<string, postinglist>> pairs;
+		for (int i = 0; i < n; i++) {
+			pairs.push_back(make_pair(to_string(numbers[i]), postinglist((streamoff) i)));
+		}
+		stringTree.bulkload(pairs);
+	});
+	double intBuild = timeIt(3, [&]() {
+		vector<pair<int64_t, postinglist>> pairs;
+		for (int i = 0; i < n; i++) {
+			pairs.push_back(make_pair(numbers[i], postinglist((streamoff) i)));
+		}
+		intTree.bulkload(pairs);
+	});
+
+	vector<string> text;
+	for (int64_t value : numbers) {
+		text.push_back(to_string(value));
+	}
+	streamoff stringSum = 0, intSum = 0;
+	double stringLookup = timeIt(3, [&]() {
+		stringSum = 0;
+		for (const string& key : text) {
+			stringSum += *stringTree.search(key)->begin();
+		}
+	});
+	double intLookup = timeIt(3, [&]() {
+		intSum = 0;
+		for (int64_t key : numbers) {
+			intSum += *intTree.search(key)->begin();
+		}
+	});
+
+	size_t stringRange = 0, intRange = 0;
+	double stringTime = timeIt(5, [&]() {
+		stringRange = 0;
+		for (auto it = stringTree.begin(), last = stringTree.lower_bound(to_string(high)); it != last; ++it) {
+			stringRange += it.value().size();
+		}
+	});
+	double intTime = timeIt(5, [&]() {
+		intRange = 0;
+		for (auto it = intTree.begin(), last = intTree.lower_bound(high); it != last; ++it) {
+			intRange += it.value().size();
+		}
+	});
+	size_t expected = count_if(numbers.begin(), numbers.end(), [&](int64_t v) {	return v < high;	});
+
+	string suffix = "/" + to_string(n);
+	report("keys/build/string" + suffix, n, stringBuild);
+	report("keys/build/int" + suffix, n, intBuild);
+	report("keys/lookup/string" + suffix, n, stringLookup);
+	report("keys/lookup/int" + suffix, n, intLookup);
+	report("keys/range/string" + suffix, max((size_t) 1, stringRange), stringTime);
+	report("keys/range/int" + suffix, max((size_t) 1, intRange), intTime);
+	if (stringSum != intSum || intRange != expected) {
+		checkFailed("keys n=" + to_string(n) + " int index disagrees.");
+	}
+
+}
+
+
+// heap bytes in use, to measure what an index costs
+size_t heapInUse() {
+
+	struct mallinfo2 info = mallinfo2();
+	return info.uordblks + info.hblkhd;  // small blocks, and large ones mapped on their own
+
+}
+
+
+// n distinct station-like names, 20 to 30 characters, back to back in
+// one buffer the way a string column is in a mapped .data file, as
+// string keys and as fieldkeys viewing the buffer: the memory each
+// index takes, and looking up every name.
+void benchFieldKeys(int n) {
+
+	mt19937 rng(12345);
+	uniform_int_distribution<int> letter('a', 'z');
+	string file;
+	vector<pair<size_t, size_t>> spans;  // start, length of each name in file
+	for (int i = 0; i < n; i++) {
+		string name = to_string(i) + "_";
+		int length = 20 + i % 11;
+		while ((int) name.size() < length) {
+			name += (char) letter(rng);
+		}
+		spans.push_back(make_pair(file.size(), name.size()));
+		file += name;
+		file += ' ';
+	}
+	shuffle(spans.begin(), spans.end(), rng);
+
+	size_t before = heapInUse();
+	avltree<string, postinglist> stringTree;
+	{
+		vector<pair<string, postinglist>> pairs;
+		for (const pair<size_t, size_t>& span : spans) {
+			pairs.push_back(make_pair(file.substr(span.first, span.second), postinglist((streamoff) span.first)));
+		}
+		stringTree.bulkload(pairs);
+	}
+	size_t stringBytes = heapInUse() - before;
+
+	before = heapInUse();
+	avltree<fieldkey, postinglist> viewTree;
+	{
+		vector<pair<fieldkey, postinglist>> pairs;
+		for (const pair<size_t, size_t>& span : spans) {
+			pairs.push_back(make_pair(fieldkey(string_view(file).substr(span.first, span.second)), postinglist((streamoff) span.first)));
+		}
+		viewTree.bulkload(pairs);
+	}
+	size_t viewBytes = heapInUse() - before;
+
+	vector<string> keys;
+	for (const pair<size_t, size_t>& span : spans) {
+		keys.push_back(file.substr(span.first, span.second));
+	}
+	streamoff stringSum = 0, viewSum = 0;
+	double stringTime = timeIt(3, [&]() {
+		stringSum = 0;
+		for (const string& key : keys) {
+			stringSum += *stringTree.search(key)->begin();
+		}
+	});
+	double viewTime = timeIt(3, [&]() {
+		viewSum = 0;
+		for (const string& key : keys) {
+			viewSum += *viewTree.search(fieldkey(key))->begin();
+		}
+	});
+
+	string suffix = "/" + to_string(n);
+	cout << left << setw(40) << "keys/memory/string" + suffix << right
+	<< setw(12) << stringBytes / n << " bytes/key" << endl;
+	cout << left << setw(40) << "keys/memory/fieldkey" + suffix << right
+	<< setw(12) << viewBytes / n << " bytes/key" << endl;
+	report("keys/lookup/name/string" + suffix, n, stringTime);
+	report("keys/lookup/name/fieldkey" + suffix, n, viewTime);
+	if (stringSum != viewSum) {
+		checkFailed("keys n=" + to_string(n) + " fieldkey index disagrees.");
+	}
+
+}
+
+
+// writes the synthetic table name of n records: id, key1 and num2, the
+// latter two drawn from distinct values by distribution
+tablespec makeTable(string name, int64_t n, int64_t distinct, string distribution) {
+
+	tablespec spec;
+	spec.Name = name;
+	spec.Rows = n;
+	spec.Columns = 3;
+	spec.Distinct = distinct;
+	spec.Distribution = distribution;
+	if (!WriteTable(spec, cout)) {
+		exit(1);
+	}
+	return spec;
+
+}
+
+
+// removes a synthetic table, and whatever was made from it
+void removeTable(const tablespec& spec) {
+
+	remove((spec.Name + ".data").c_str());
+	remove((spec.Name + ".meta").c_str());
+	remove((spec.Name + ".col").c_str());
+	remove((spec.Name + ".wal").c_str());
+	for (int c = 0; c < spec.Columns; c++) {
+		remove((spec.Name + "." + SyntheticColumn(c) + ".idx").c_str());
+		remove((spec.Name + "." + SyntheticColumn(c) + ".bt").c_str());
+	}
+
+}
+
+
+// avltree's own operations on n random keys: inserting them one at a
+// time, searching for each (and for keys it doesn't hold), the
+// distance between random pairs, and removing them all again.
+void benchAvl(int n) {
+
+	vector<pair<string, streamoff>> pairs = makePairs(n, 80);
+	avltree<string, streamoff> tree;
+	double insertTime = timeIt(1, [&]() {
+		for (size_t i = 0; i < pairs.size(); i++) {
+			tree.insert(pairs[i].first, pairs[i].second);
+		}
+	});
+
+	vector<string> keys, missing;
+	for (size_t i = 0; i < pairs.size(); i++) {
+		keys.push_back(pairs[i].first);
+		missing.push_back(pairs[i].first + "x");
+	}
+	shuffle(keys.begin(), keys.end(), mt19937(42));
+	long found = 0;
+	double searchTime = timeIt(3, [&]() {
+		for (const string& key : keys) {
+			found += (tree.search(key) != nullptr);
+		}
+	});
+	double missTime = timeIt(3, [&]() {
+		for (const string& key : missing) {
+			found += (tree.search(key) != nullptr);
+		}
+	});
+
+	const size_t numPairs = min<size_t>(keys.size(), 100000);
+	long total = 0;
+	double distanceTime = timeIt(3, [&]() {
+		for (size_t i = 0; i < numPairs; i++) {
+			total += tree.distance(keys[i], keys[(i * 7919 + 1) % keys.size()]);
+		}
+	});
+
+	size_t size = tree.size(), removed = 0; // keys may repeat, and are only in the tree once
+	double removeTime = timeIt(1, [&]() {
+		for (const string& key : keys) {
+			removed += tree.remove(key);
+		}
+	});
+	if (removed != size || tree.size() != 0) {
+		checkFailed("avltree n=" + to_string(n) + " remove missed keys.");
+	}
+
+	string suffix = "/" + to_string(n);
+	report("avltree/insert" + suffix, n, insertTime);
+	report("avltree/search" + suffix, keys.size(), searchTime);
+	report("avltree/search_miss" + suffix, missing.size(), missTime);
+	report("avltree/distance" + suffix, numPairs, distanceTime);
+	report("avltree/remove" + suffix, keys.size(), removeTime);
+
+}
+
+
+// reading records by position: GetRecord at random positions of a
+// synthetic table, straight from the mapping and through a dbtable's
+// record cache (which holds every record, after the first pass).
+void benchGetRecord(int n) {
+
+	tablespec spec = makeTable("benchrecord", n, n, "uniform");
+	dbtable table;
+	table.open(spec.Name);
+	table.setRecordCache(n);
+
+	vector<streamoff> positions;
+	mt19937 rng(7);
+	for (int i = 0; i < n; i++) {
+		positions.push_back((streamoff) (rng() % n) * table.recordSize());
+	}
+	vector<string_view> values;
+	size_t bytes = 0;
+	double directTime = timeIt(3, [&]() {
+		for (streamoff pos : positions) {
+			GetRecord(table.data(), pos, values);
+			bytes += values[1].size();
+		}
+	});
+	double cachedTime = timeIt(3, [&]() {
+		for (streamoff pos : positions) {
+			table.getRecord(pos, values);
+			bytes += values[1].size();
+		}
+	});
+
+	report("getrecord/mapped/" + to_string(n), n, directTime);
+	report("getrecord/cached/" + to_string(n), n, cachedTime);
+	removeTable(spec);
+
+}
+
+
+// scans of an unindexed column of a synthetic table: LinearSearch for
+// one value, the same for a where clause on 1 thread and then 2, 4, ...
+// threads, and a scan of the same column in the typed .col file.
+void benchScan(int n) {
+
+	tablespec spec = makeTable("benchscan", n, 50, "uniform");
+	dbtable table;
+	table.open(spec.Name);
+	const datafile& data = table.data();
+	predicate where;
+	where.Op = "=";
+	where.Value = "25";
+	where.prepare(table.columnTypes()[2]);
+	string suffix = "/" + to_string(n);
+
+	size_t found = 0;
+	double valueTime = timeIt(5, [&]() { found = LinearSearch(data, where.Value, 3).size(); });
+	report("scan/linear_value" + suffix, n, valueTime);
+	double serialTime = timeIt(5, [&]() { found = LinearSearch(data, where, 3).size(); });
+	report("scan/linear/threads:1" + suffix, n, serialTime);
+
+	int maxThreads = max(2u, thread::hardware_concurrency());
+	for (int threads = 2; threads <= maxThreads; threads *= 2) {
+		workerpool pool(threads);
+		double parallelTime = timeIt(5, [&]() { found = LinearSearch(data, where, 3, &pool).size(); });
+		report("scan/linear/threads:" + to_string(threads) + suffix, n, parallelTime);
+	}
+
+	SaveColumns(spec.Name + ".col", data, table.columnTypes(), cout);
+	columnfile columns;
+	columns.open(spec.Name, data, table.columnTypes());
+	vector<streamoff> matches;
+	double columnTime = timeIt(5, [&]() {
+		matches.clear();
+		ColumnSearch(columns, where, 2, table.recordSize(), matches);
+	});
+	report("scan/column" + suffix, n, columnTime);
+	if (matches.size() != found) {
+		checkFailed("scan n=" + to_string(n) + " .col and .data scans disagree.");
+	}
+	columns.close();
+	removeTable(spec);
+
+}
+
+
+// end-to-end queries, as program.exe runs them: parsed through a plan
+// cache, answered along the chosen access path, and the records printed
+// (to memory).  The table has avl indexes on id and key1 and none on
+// num2; key1 and num2 take n / 10 values, following distribution.
+void benchQueries(int n, string distribution) {
+
+	tablespec spec;
+	spec.Name = "benchquery";
+	spec.Rows = n;
+	spec.Columns = 3;
+	spec.Distinct = max(1, n / 10);
+	spec.Distribution = distribution;
+	spec.Indexed = { 0, 1 };
+	if (!WriteTable(spec, cout)) {
+		exit(1);
+	}
+
+	dbtable table;
+	table.open(spec.Name);
+	table.buildIndexes();
+	plancache plans(table);
+	vector<string_view> dataRecord;
+	ostringstream out;
+
+	mt19937 rng(99);
+	auto run = [&](const string& name, int numQueries, auto makeQuery) {
+		vector<string> queries;
+		for (int i = 0; i < numQueries; i++) {
+			queries.push_back(makeQuery());
+		}
+		double time = timeIt(3, [&]() {
+			for (const string& text : queries) {
+				SelectRecords(table, plans.prepare(text), dataRecord, out);
+				out.str("");
+			}
+		});
+		report("query/" + name + "/" + distribution + "/" + to_string(n), numQueries, time);
+	};
+	string prefix = "select * from " + spec.Name + " where ";
+	run("point", 10000, [&]() {	return prefix + "id = " + to_string(rng() % n);	});
+	run("key", 10000, [&]() {	return prefix + "key1 = k" + to_string(rng() % spec.Distinct);	});
+	run("range", 1000, [&]() {
+		int64_t first = rng() % n;
+		return prefix + "id between " + to_string(first) + " and " + to_string(first + 9);
+	});
+	run("scan", 20, [&]() {	return prefix + "num2 = " + to_string(rng() % spec.Distinct);	});
+	// two indexes intersected; an index with a residual test; a union of
+	// indexes; and an or of unindexed terms, which is still one scan
+	run("and_index", 1000, [&]() {
+		int64_t first = rng() % n;
+		return prefix + "id between " + to_string(first) + " and " + to_string(first + 49) +
+			" and key1 = k" + to_string(rng() % spec.Distinct);
+	});
+	run("and_residual", 1000, [&]() {
+		return prefix + "key1 = k" + to_string(rng() % spec.Distinct) + " and num2 < " + to_string(rng() % spec.Distinct);
+	});
+	run("or_index", 1000, [&]() {
+		return prefix + "id = " + to_string(rng() % n) + " or key1 = k" + to_string(rng() % spec.Distinct);
+	});
+	run("or_scan", 20, [&]() {
+		return prefix + "num2 = " + to_string(rng() % spec.Distinct) + " or num2 = " + to_string(rng() % spec.Distinct);
+	});
+	removeTable(spec);
+
+}
+
+
+// writes name.data and name.meta: n records shaped like the stations
+// table --- id, name, latitude, longitude, capacity, opened --- with id
+// indexed (avl).  Stations share about 600 names and 1000 opening days.
+void writeStations(string name, int64_t n) {
+
+	const int recordSize = 80;
+	ofstream meta(name + ".meta", ios::out | ios::trunc);
+	ofstream data(name + ".data", ios::out | ios::binary | ios::trunc);
+	meta << recordSize << '\n' << 6 << '\n' << "id:int 1\nname 0\nlatitude:double 0\nlongitude:double 0\n"
+		<< "capacity:int 0\nopened 0\n";
+
+	mt19937 rng(7);
+	string record;
+	char number[32];
+	for (int64_t id = 0; id < n; id++) {
+		record = to_string(id) + " St_" + to_string(rng() % 600) + "_Ave ";
+		snprintf(number, sizeof(number), "%.6f %.6f ", 41.7 + (rng() % 400000) / 1e6, -87.8 + (rng() % 300000) / 1e6);
+		record += number;
+		record += to_string(11 + rng() % 37) + " ";
+		int day = rng() % 1000;
+		record += to_string(1 + day % 12) + "/" + to_string(1 + day / 12 % 28) + "/" + to_string(2013 + day % 3) + " ";
+		record.resize(recordSize - 2, '.');
+		record += "\r\n";
+		data.write(record.data(), record.size());
+	}
+
+}
+
+
+// aggregate queries over n synthetic stations, as program.exe runs
+// them: count(*) (from the record count), min/max of the indexed id
+// (from the index alone), and sums, averages, min/max and group by of
+// unindexed columns, read in batches from the .data file and then from
+// the .col file.  Items are the records aggregated, so the rate is
+// records per second.  "select_all" is the same records fetched and
+// printed instead, for an aggregate computed outside the engine.
+void benchAggregates(int n) {
+
+	string name = "benchagg";
+	writeStations(name, n);
+	string suffix = "/" + to_string(n);
+	string results[2];  // sum_avg's answer from .data, and from .col
+
+	for (int pass = 0; pass < 2; pass++) {
+		if (pass == 1) {
+			dbtable data;
+			data.open(name);
+			SaveColumns(name + ".col", data.data(), data.columnTypes(), cout);
+		}
+		dbtable table;
+		table.open(name);
+		table.buildIndexes();
+		plancache plans(table);
+		vector<string_view> dataRecord;
+		ostringstream out;
+		string from = table.columns().isOpen() ? "col" : "data";
+
+		auto run = [&](const string& label, int64_t items, int reps, const string& text) {
+			double time = timeIt(reps, [&]() {
+				out.str("");
+				SelectRecords(table, plans.prepare(text), dataRecord, out);
+			});
+			report("agg/" + label + suffix, items, time);
+		};
+		string fromTable = " from " + name;
+		if (pass == 0) {
+			run("count", n, 5, "select count(*)" + fromTable);
+			run("index_only", n / 2, 5, "select count(*),min(id),max(id)" + fromTable + " where id < " + to_string(n / 2));
+			run("select_all/data", n, 1, "select capacity" + fromTable + " where id >= 0");
+		}
+		run("sum_avg/" + from, n, 5, "select sum(capacity),avg(latitude)" + fromTable);
+		results[pass] = out.str();
+		run("min_max/" + from, n, 5, "select min(latitude),max(longitude),min(capacity),max(capacity)" + fromTable);
+		run("where/" + from, n / 10, 5, "select sum(capacity),avg(latitude)" + fromTable + " where id < " + to_string(n / 10));
+		run("group_by/" + from, n, 3, "select count(*),avg(capacity)" + fromTable + " group by opened");
+	}
+	if (results[0] != results[1]) {
+		checkFailed("agg n=" + to_string(n) + " .col and .data aggregates disagree.");
+	}
+
+	// a .col file made after every record of one capacity was deleted
+	// still has them, and grouping by capacity must leave that one out
+	{
+		dbtable table;
+		table.open(name);
+		table.buildIndexes(); // a write keeps them up to date, so they must be there
+		query q;
+		ParseQuery(table, "delete from " + name + " where capacity = 47", q);
+		ostringstream out;
+		WriteRecords(table, q, out);
+	}
+	{
+		dbtable data;
+		data.open(name);
+		SaveColumns(name + ".col", data.data(), data.columnTypes(), cout);
+	}
+	{
+		dbtable table;
+		table.open(name);
+		query q;
+		ParseQuery(table, "select count(*),sum(capacity) from " + name + " group by capacity", q);
+		vector<string_view> dataRecord;
+		ostringstream out;
+		SelectRecords(table, q, dataRecord, out);
+		if (!table.columns().isOpen() || out.str().find("capacity: 47") != string::npos) {
+			checkFailed("agg n=" + to_string(n) + " group by shows a group whose records are deleted.");
+		}
+	}
+
+	for (string file : { ".data", ".meta", ".col", ".wal", ".id.idx" }) {
+		remove((name + file).c_str());
+	}
+
+}
+
+
+// the write path, on a synthetic table of n records with id and key1
+// indexed by kind (avl, btree or hash; none for no indexes): inserts,
+// each synced to disk and not, then updates and deletes of records
+// found by id.  Each is a query run as program.exe runs it, so the
+// cost includes parsing, the log, the .data file and every index.
+void benchWrites(int n, string kind) {
+
+	tablespec spec;
+	spec.Name = "benchwrite";
+	spec.Rows = n;
+	spec.Columns = 3;
+	spec.Distinct = max(1, n / 10);
+	if (kind != "none") {
+		spec.Indexed = { 0, 1 };
+		spec.IndexKind = (kind == "avl") ? "1" : kind;
+	}
+	else {
+		spec.Indexed.clear();
+	}
+	if (!WriteTable(spec, cout)) {
+		exit(1);
+	}
+
+	{
+		dbtable table;
+		table.open(spec.Name);
+		table.buildIndexes();
+		plancache plans(table);
+		ostringstream out;
+		mt19937 rng(5);
+		int64_t next = 0; // ids are reused, so records stay the same size
+		auto insert = [&]() {
+			next = (next + 7919) % n; // 7919 is prime, so this visits every id
+			return "insert into " + spec.Name + " values " + to_string(next) +
+				" k" + to_string(rng() % spec.Distinct) + " " + to_string(rng() % spec.Distinct);
+		};
+		auto run = [&](const string& name, int numQueries, auto makeQuery) {
+			vector<string> queries;
+			for (int i = 0; i < numQueries; i++) {
+				queries.push_back(makeQuery());
+			}
+			double time = timeIt(1, [&]() {
+				for (const string& text : queries) {
+					WriteRecords(table, plans.prepare(text), out);
+				}
+			});
+			out.str("");
+			report("write/" + name + "/" + kind + "/" + to_string(n), numQueries, time);
+		};
+
+		// the first write thaws hash indexes and starts maintenance; not timed
+		WriteRecords(table, plans.prepare(insert()), out);
+		run("insert_sync", 200, insert);
+		table.setSyncWrites(false);
+		run("insert", 10000, insert);
+		if (kind != "none") { // without an index, finding each record is a scan
+			run("update", 10000, [&]() {
+				return "update " + spec.Name + " set key1 = k" + to_string(rng() % spec.Distinct) +
+					" where id = " + to_string(rng() % n);
+			});
+			next = 0;
+			run("delete", 10000, [&]() {
+				next = (next + 7919) % n;
+				return "delete from " + spec.Name + " where id = " + to_string(next);
+			});
+		}
+	}
+	removeTable(spec);
+
+}
+
+
+// usage: bench.exe [--rows N] [--filter group] [--json file]
+// runs the benchmarks on up to --rows records (default 1000000) and
+// prints one line per measurement.  --filter runs only the groups whose
+// name contains group (build, pool, avltree, lookup, keys, getrecord,
+// scan, query, agg, write); --json also writes the results to file, for comparing runs
+// across versions.
+int main(int argc, char* argv[]) {
+
+	int maxRows = 1000000;
+	string jsonFile;
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		if (arg == "--rows" && i + 1 < argc) {
+			maxRows = max(1000, atoi(argv[++i]));
+		}
+		else if (arg == "--filter" && i + 1 < argc) {
+			Filter = argv[++i];
+		}
+		else if (arg == "--json" && i + 1 < argc) {
+			jsonFile = argv[++i];
+		}
+	}
+	vector<int> sizes;
+	for (int n = 1000; n <= maxRows; n *= 10) {
+		sizes.push_back(n);
+	}
+
+	if (selected("build")) {
+		for (int n : sizes) {
+			benchBuild(n);
+		}
+	}
+	if (selected("pool")) {
+		vector<pair<string, streamoff>> pairs = makePairs(maxRows, 80);
+		benchPool<heappool>("heap", pairs);
+		benchPool<slabpool>("slab", pairs);
+	}
+	if (selected("avltree")) {
+		for (int n : sizes) {
+			benchAvl(n);
+		}
+	}
+	if (selected("lookup")) {
+		benchLookup(min(10000, maxRows));
+		benchLookup(maxRows);
+	}
+	if (selected("keys")) {
+		benchKeys(maxRows);
+		benchFieldKeys(maxRows);
+	}
+	if (selected("getrecord")) {
+		benchGetRecord(maxRows);
+	}
+	if (selected("scan")) {
+		benchScan(maxRows);
+	}
+	if (selected("query")) {
+		benchQueries(maxRows, "uniform");
+		benchQueries(maxRows, "zipf");
+	}
+	if (selected("agg")) {
+		benchAggregates(maxRows);
+	}
+	if (selected("write")) {
+		for (string kind : { "none", "avl", "btree", "hash" }) {
+			benchWrites(maxRows, kind);
+		}
+	}
+
+	if (jsonFile != "" && !writeJson(jsonFile)) {
+		cout << "**Error: couldn't write '" << jsonFile << "'." << endl;
+		return 1;
+	}
+	return (NumErrors > 0) ? 1 : 0;
+
+}
@@ -0,0 +1,702 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <climits>
+#include <fcntl.h>
+#include <unistd.h>
+#include "btree.h"
+#include "stats.h"
+using namespace std;
+
+
+// Page layout.  Every page but page 0 is a node:
+//   [0]  uint16 count         # of entries
+//   [2]  uint16 heapStart     entries are packed from here to the end of the page
+//   [4]  uint8  leaf          1 for leaves
+//   [8]  uint32 link          leaves: next leaf to the right (0 if last);
+//                             internal: child holding entries below the first separator
+//   [16] uint16 offset[count] where each entry starts, in sorted order
+// and each entry is a uint16 key length, the key bytes, an int64 position,
+// and for internal pages a uint32 child page holding entries >= this one.
+// Page 0 holds the tree's metadata, see _writemeta.
+static const int HeaderSize = 16;
+static const char MetaMagic[8] = {'m', 'y', 'D', 'B', 'b', 'p', 't', '1'};
+
+
+static inline uint16_t get16(const char* p) {	uint16_t v; memcpy(&v, p, 2); return v;	}
+static inline uint32_t get32(const char* p) {	uint32_t v; memcpy(&v, p, 4); return v;	}
+static inline int64_t  get64(const char* p) {	int64_t v;  memcpy(&v, p, 8); return v;	}
+static inline void put16(char* p, uint16_t v) {	memcpy(p, &v, 2);	}
+static inline void put32(char* p, uint32_t v) {	memcpy(p, &v, 4);	}
+static inline void put64(char* p, int64_t v)  {	memcpy(p, &v, 8);	}
+
+
+// bytes an entry takes in a page, counting its offset slot
+static inline int entrySize(size_t keyLength, bool leaf) {
+
+	return 2 + 2 + keyLength + 8 + (leaf ? 0 : 4);
+
+}
+
+
+// compares (key, value) pairs: by key, then by value
+static inline int compareEntry(string_view key1, streamoff value1, string_view key2, streamoff value2) {
+
+	int c = key1.compare(key2);
+	if (c != 0) {
+		return c;
+	}
+	return (value1 < value2) ? -1 : (value1 > value2) ? 1 : 0;
+
+}
+
+
+// the key and position of entry slot of an encoded page
+static inline void pageEntry(const char* data, int slot, string_view& key, streamoff& value) {
+
+	const char* entry = data + get16(data + HeaderSize + 2 * slot);
+	uint16_t keyLength = get16(entry);
+	key = string_view(entry + 2, keyLength);
+	value = get64(entry + 2 + keyLength);
+
+}
+
+
+// the child page of entry slot of an encoded internal page
+static inline uint32_t pageChild(const char* data, int slot) {
+
+	const char* entry = data + get16(data + HeaderSize + 2 * slot);
+	uint16_t keyLength = get16(entry);
+	return get32(entry + 2 + keyLength + 8);
+
+}
+
+
+btree::btree() {
+
+	File = -1;
+	Root = 0;
+	Height = -1;
+	Size = 0;
+	NumPages = 0;
+	Stamp[0] = Stamp[1] = Stamp[2] = Stamp[3] = 0;
+	CachePages = 1;
+	Hits = Misses = 0;
+
+}
+
+
+btree::~btree() {
+
+	close();
+
+}
+
+
+// returns the cached copy of a page, reading it in (and evicting the
+// least recently used page) if needed.  Call with CacheLock held; the
+// pointer is only good until the next _page call.
+char* btree::_page(uint32_t page, bool dirty) const {
+
+	auto found = Cached.find(page);
+	if (found != Cached.end()) {
+		Hits++;
+		Frames.splice(Frames.begin(), Frames, found->second); // now most recently used
+		Frames.front().Dirty |= dirty;
+		return Frames.front().Data;
+	}
+
+	Misses++;
+	CountStat(&querystats::BytesRead, PageSize);
+	if (Frames.size() >= CachePages) { // evict the least recently used page
+		// a dirty page that couldn't be written is kept rather than lost,
+		// and flush() tries it again
+		FRAME& victim = Frames.back();
+		if (!victim.Dirty || pwrite(File, victim.Data, PageSize, (off_t) victim.Page * PageSize) == PageSize) {
+			Cached.erase(victim.Page);
+			Frames.pop_back();
+		}
+	}
+	Frames.emplace_front();
+	FRAME& frame = Frames.front();
+	frame.Page = page;
+	frame.Dirty = dirty;
+	if (pread(File, frame.Data, PageSize, (off_t) page * PageSize) != PageSize) {
+		memset(frame.Data, 0, PageSize); // a new page, not written yet
+	}
+	Cached[page] = Frames.begin();
+	return frame.Data;
+
+}
+
+
+// adds an empty node page to the end of the file
+uint32_t btree::_newpage(bool leaf) {
+
+	lock_guard<mutex> guard(CacheLock);
+	uint32_t page = NumPages++;
+	char* data = _page(page, true);
+	memset(data, 0, PageSize);
+	put16(data + 2, PageSize);
+	data[4] = leaf ? 1 : 0;
+	return page;
+
+}
+
+
+// writes the metadata page: magic, root, height, size, # of pages,
+// stamp.  Returns false if it couldn't.
+bool btree::_writemeta() {
+
+	char meta[PageSize];
+	memset(meta, 0, PageSize);
+	memcpy(meta, MetaMagic, 8);
+	put32(meta + 8, Root);
+	put32(meta + 12, (uint32_t) Height);
+	put64(meta + 16, Size);
+	put32(meta + 24, NumPages);
+	for (int i = 0; i < 4; i++) {
+		put64(meta + 32 + 8 * i, Stamp[i]);
+	}
+	return pwrite(File, meta, PageSize, 0) == PageSize;
+
+}
+
+
+// decodes every entry of a page
+void btree::_readentries(uint32_t page, vector<ENTRY>& entries, bool& leaf, uint32_t& link) const {
+
+	lock_guard<mutex> guard(CacheLock);
+	const char* data = _page(page, false);
+	int count = get16(data);
+	leaf = data[4] != 0;
+	link = get32(data + 8);
+	entries.resize(count);
+	for (int i = 0; i < count; i++) {
+		string_view key;
+		pageEntry(data, i, key, entries[i].Value);
+		entries[i].Key.assign(key.data(), key.size());
+		entries[i].Child = leaf ? 0 : pageChild(data, i);
+	}
+
+}
+
+
+// encodes entries into a page; returns false, leaving the page alone,
+// if they don't fit.
+bool btree::_writeentries(uint32_t page, const vector<ENTRY>& entries, bool leaf, uint32_t link) {
+
+	size_t bytes = HeaderSize;
+	for (const ENTRY& entry : entries) {
+		bytes += entrySize(entry.Key.size(), leaf);
+	}
+	if (bytes > PageSize) {
+		return false;
+	}
+
+	lock_guard<mutex> guard(CacheLock);
+	char* data = _page(page, true);
+	memset(data, 0, PageSize);
+	put16(data, entries.size());
+	data[4] = leaf ? 1 : 0;
+	put32(data + 8, link);
+	int heap = PageSize;
+	for (size_t i = 0; i < entries.size(); i++) {
+		const ENTRY& entry = entries[i];
+		heap -= entrySize(entry.Key.size(), leaf) - 2;
+		char* p = data + heap;
+		put16(p, entry.Key.size());
+		memcpy(p + 2, entry.Key.data(), entry.Key.size());
+		put64(p + 2 + entry.Key.size(), entry.Value);
+		if (!leaf) {
+			put32(p + 2 + entry.Key.size() + 8, entry.Child);
+		}
+		put16(data + HeaderSize + 2 * i, heap);
+	}
+	put16(data + 2, heap);
+	return true;
+
+}
+
+
+// opens an existing index file.  Returns false if it doesn't exist or
+// isn't a B+tree file.
+bool btree::open(string filename, size_t cachePages) {
+
+	close();
+	File = ::open(filename.c_str(), O_RDWR);
+	if (File < 0) {
+		return false;
+	}
+	char meta[PageSize];
+	if (pread(File, meta, PageSize, 0) != PageSize || memcmp(meta, MetaMagic, 8) != 0) {
+		::close(File);
+		File = -1;
+		return false;
+	}
+	Root = get32(meta + 8);
+	Height = (int) get32(meta + 12);
+	Size = get64(meta + 16);
+	NumPages = get32(meta + 24);
+	for (int i = 0; i < 4; i++) {
+		Stamp[i] = get64(meta + 32 + 8 * i);
+	}
+	CachePages = (cachePages < 4) ? 4 : cachePages;  // at least the top levels stay cached
+	return true;
+
+}
+
+
+// creates a new, empty index file, replacing any file of that name.
+bool btree::create(string filename, size_t cachePages) {
+
+	close();
+	File = ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (File < 0) {
+		cout << "**Error: couldn't create index file '" << filename << "'." << endl;
+		return false;
+	}
+	Root = 0;
+	Height = -1;
+	Size = 0;
+	NumPages = 1; // the metadata page
+	Stamp[0] = Stamp[1] = Stamp[2] = Stamp[3] = 0;
+	CachePages = (cachePages < 4) ? 4 : cachePages;
+	if (!_writemeta()) {
+		cout << "**Error: couldn't write index file '" << filename << "'." << endl;
+		::close(File);
+		File = -1;
+		return false;
+	}
+	return true;
+
+}
+
+
+// writes every changed page and then the metadata to the file.  Returns
+// false if a page (now or when it was evicted) or the metadata couldn't
+// be written; the metadata, and so the stamp, is only written once
+// every page is, so a file missing pages is never loaded as up to date.
+bool btree::flush() {
+
+	if (File < 0) {
+		return true;
+	}
+	lock_guard<mutex> guard(CacheLock);
+	bool ok = true;
+	for (FRAME& frame : Frames) {
+		if (frame.Dirty) {
+			if (pwrite(File, frame.Data, PageSize, (off_t) frame.Page * PageSize) == PageSize) {
+				frame.Dirty = false;
+			}
+			else {
+				ok = false;
+			}
+		}
+	}
+	return ok && _writemeta();
+
+}
+
+
+// flushes, then closes the file and empties the cache
+void btree::close() {
+
+	if (File < 0) {
+		return;
+	}
+	flush();
+	Frames.clear();
+	Cached.clear();
+	::close(File);
+	File = -1;
+
+}
+
+
+void btree::setStamp(int64_t a, int64_t b, int64_t c, int64_t d) {
+
+	Stamp[0] = a;
+	Stamp[1] = b;
+	Stamp[2] = c;
+	Stamp[3] = d;
+
+}
+
+
+// where to split entries that overflowed a page: the first index at
+// which the entries before it hold at least half the bytes, so both
+// halves fit even when key sizes vary.
+static size_t splitPoint(const vector<string>& keys, bool leaf) {
+
+	size_t total = 0;
+	for (const string& key : keys) {
+		total += entrySize(key.size(), leaf);
+	}
+	size_t bytes = 0, i = 0;
+	while (i + 1 < keys.size() && 2 * bytes < total) {
+		bytes += entrySize(keys[i].size(), leaf);
+		i++;
+	}
+	return (i == 0) ? 1 : i;
+
+}
+
+
+// replaces the tree with the given entries, which must be sorted by
+// key and then position.  Leaves are packed full left to right, then
+// each level of internal pages is built over the one below, so the
+// tree is built in one pass with no splits.  Keys longer than
+// MaxKeySize are skipped.
+void btree::bulkload(vector<pair<string, streamoff>>& pairs) {
+
+	Root = 0;
+	Height = -1;
+	Size = 0;
+	NumPages = 1;
+	{
+		lock_guard<mutex> guard(CacheLock);
+		Frames.clear();
+		Cached.clear();
+	}
+	if (ftruncate(File, PageSize) != 0) {
+		return;
+	}
+
+	// the first entry in each page of a level, with Child set to the page
+	vector<ENTRY> level;
+
+	// leaves: a leaf is written once the next one exists, to link to it
+	vector<ENTRY> entries, prevEntries;
+	uint32_t prevLeaf = 0;
+	size_t bytes = HeaderSize;
+	auto finishLeaf = [&]() {
+		uint32_t leaf = _newpage(true);
+		if (prevLeaf != 0) {
+			_writeentries(prevLeaf, prevEntries, true, leaf);
+		}
+		level.push_back(ENTRY{ entries[0].Key, entries[0].Value, leaf });
+		prevLeaf = leaf;
+		prevEntries.swap(entries);
+		entries.clear();
+		bytes = HeaderSize;
+	};
+	for (size_t i = 0; i < pairs.size(); i++) {
+		if (pairs[i].first.size() > MaxKeySize) {
+			continue;
+		}
+		if (bytes + entrySize(pairs[i].first.size(), true) > PageSize) {
+			finishLeaf();
+		}
+		entries.push_back(ENTRY{ std::move(pairs[i].first), pairs[i].second, 0 });
+		bytes += entrySize(entries.back().Key.size(), true);
+		Size++;
+	}
+	if (!entries.empty()) {
+		finishLeaf();
+	}
+	if (prevLeaf == 0) { // no entries
+		flush();
+		return;
+	}
+	_writeentries(prevLeaf, prevEntries, true, 0);
+	Height = 0;
+
+	// internal levels: each page links to its first child and holds the
+	// first entry of every other child, until one page is left
+	while (level.size() > 1) {
+		vector<ENTRY> upper;
+		size_t i = 0;
+		while (i < level.size()) {
+			uint32_t node = _newpage(false);
+			uint32_t link = level[i].Child;
+			upper.push_back(ENTRY{ level[i].Key, level[i].Value, node });
+			i++;
+			entries.clear();
+			bytes = HeaderSize;
+			while (i < level.size() && bytes + entrySize(level[i].Key.size(), false) <= PageSize) {
+				bytes += entrySize(level[i].Key.size(), false);
+				entries.push_back(level[i]);
+				i++;
+			}
+			_writeentries(node, entries, false, link);
+		}
+		level.swap(upper);
+		Height++;
+	}
+	Root = level[0].Child;
+	flush();
+
+}
+
+
+// inserts entry under page.  Returns true if page had to split, with
+// split set to the separator for the new page to its right.
+bool btree::_insert(uint32_t page, const ENTRY& entry, vector<ENTRY>& split) {
+
+	vector<ENTRY> entries;
+	bool leaf;
+	uint32_t link;
+	_readentries(page, entries, leaf, link);
+
+	// slot: # of entries <= the new one
+	size_t slot = 0;
+	while (slot < entries.size() && compareEntry(entries[slot].Key, entries[slot].Value, entry.Key, entry.Value) <= 0) {
+		slot++;
+	}
+
+	if (!leaf) { // insert into the child, then take in its separator if it split
+		uint32_t child = (slot == 0) ? link : entries[slot - 1].Child;
+		vector<ENTRY> childSplit;
+		if (!_insert(child, entry, childSplit)) {
+			return false;
+		}
+		entries.insert(entries.begin() + slot, childSplit[0]);
+	}
+	else {
+		entries.insert(entries.begin() + slot, entry);
+	}
+	if (_writeentries(page, entries, leaf, link)) {
+		return false;
+	}
+
+	// overflowed, split in two by bytes
+	vector<string> keys;
+	for (const ENTRY& e : entries) {
+		keys.push_back(e.Key);
+	}
+	size_t mid = splitPoint(keys, leaf);
+	uint32_t right = _newpage(leaf);
+	if (leaf) { // right half moves to a new leaf, linked in after this one
+		vector<ENTRY> upper(entries.begin() + mid, entries.end());
+		_writeentries(right, upper, true, link);
+		split.assign(1, ENTRY{ upper[0].Key, upper[0].Value, right });
+		entries.resize(mid);
+		_writeentries(page, entries, true, right);
+	}
+	else { // the middle separator moves up, its child starts the new page
+		vector<ENTRY> upper(entries.begin() + mid + 1, entries.end());
+		_writeentries(right, upper, false, entries[mid].Child);
+		split.assign(1, ENTRY{ entries[mid].Key, entries[mid].Value, right });
+		entries.resize(mid);
+		_writeentries(page, entries, false, link);
+	}
+	return true;
+
+}
+
+
+// adds one (key, position) entry.  Returns false if the key is too
+// long to index.
+bool btree::insert(const string& key, streamoff value) {
+
+	if (key.size() > MaxKeySize) {
+		return false;
+	}
+	ENTRY entry{ key, value, 0 };
+	if (Height < 0) { // first entry, the root is a leaf
+		Root = _newpage(true);
+		_writeentries(Root, vector<ENTRY>(1, entry), true, 0);
+		Height = 0;
+	}
+	else {
+		vector<ENTRY> split;
+		if (_insert(Root, entry, split)) { // root split, grow a level
+			uint32_t newRoot = _newpage(false);
+			_writeentries(newRoot, split, false, Root);
+			Root = newRoot;
+			Height++;
+		}
+	}
+	Size++;
+	return true;
+
+}
+
+
+// removes one (key, position) entry.  Pages are never merged: a leaf may
+// be left underfull, or empty, and separators of removed entries stay
+// in the pages above, where they still route searches correctly.
+// Returns false if there is no such entry.
+bool btree::remove(const string& key, streamoff value) {
+
+	iterator it;
+	it.Tree = this;
+	_position(key, value, it.Page, it.Slot);
+	it._load(); // the entry may start the next leaf
+	if (it.Page == 0 || it.Key != key || it.Value != value) {
+		return false;
+	}
+	vector<ENTRY> entries;
+	bool leaf;
+	uint32_t link;
+	_readentries(it.Page, entries, leaf, link);
+	entries.erase(entries.begin() + it.Slot);
+	_writeentries(it.Page, entries, true, link);
+	Size--;
+	return true;
+
+}
+
+
+// replaces the position p of every entry, separators included, with
+// fn(p).  fn must keep positions in order, so no entry moves.
+void btree::remap(const function<streamoff(streamoff)>& fn) {
+
+	lock_guard<mutex> guard(CacheLock);
+	for (uint32_t page = 1; page < NumPages; page++) {
+		char* data = _page(page, true);
+		int count = get16(data);
+		for (int slot = 0; slot < count; slot++) {
+			char* entry = data + get16(data + HeaderSize + 2 * slot);
+			char* value = entry + 2 + get16(entry);
+			put64(value, fn(get64(value)));
+		}
+	}
+
+}
+
+
+// finds the leaf page and slot of the first entry not less than
+// (key, value); slot may be one past the end of the leaf.
+void btree::_position(string_view key, streamoff value, uint32_t& page, int& slot) const {
+
+	page = 0;
+	slot = 0;
+	if (Height < 0) {
+		return;
+	}
+
+	lock_guard<mutex> guard(CacheLock);
+	uint32_t cur = Root;
+	for (int level = Height; level >= 0; level--) {
+		const char* data = _page(cur, false);
+		int lo = 0, hi = get16(data);
+		if (level > 0) { // internal: follow the last separator <= target
+			while (lo < hi) {
+				int mid = (lo + hi) / 2;
+				string_view midKey;
+				streamoff midValue;
+				pageEntry(data, mid, midKey, midValue);
+				if (compareEntry(midKey, midValue, key, value) <= 0) {
+					lo = mid + 1;
+				}
+				else {
+					hi = mid;
+				}
+			}
+			cur = (lo == 0) ? get32(data + 8) : pageChild(data, lo - 1);
+		}
+		else { // leaf: first entry >= target
+			while (lo < hi) {
+				int mid = (lo + hi) / 2;
+				string_view midKey;
+				streamoff midValue;
+				pageEntry(data, mid, midKey, midValue);
+				if (compareEntry(midKey, midValue, key, value) < 0) {
+					lo = mid + 1;
+				}
+				else {
+					hi = mid;
+				}
+			}
+			page = cur;
+			slot = lo;
+		}
+	}
+	CountStat(&querystats::NodesVisited, Height + 1);
+
+}
+
+
+// copies out entry slot of a leaf.  Returns false if the leaf has no
+// such slot, with next set to the leaf to its right (0 if none).
+bool btree::_entry(uint32_t page, int slot, string& key, streamoff& value, uint32_t& next) const {
+
+	lock_guard<mutex> guard(CacheLock);
+	const char* data = _page(page, false);
+	if (slot < get16(data)) {
+		string_view found;
+		pageEntry(data, slot, found, value);
+		key.assign(found.data(), found.size());
+		return true;
+	}
+	next = get32(data + 8);
+	return false;
+
+}
+
+
+// moves to the current slot's entry, or on to the next leaf if the
+// slot is past the end of this one
+void btree::iterator::_load() {
+
+	while (Page != 0) {
+		uint32_t next;
+		if (Tree->_entry(Page, Slot, Key, Value, next)) {
+			return;
+		}
+		Page = next;
+		Slot = 0;
+		CountStat(&querystats::NodesVisited, Page != 0);
+	}
+
+}
+
+
+btree::iterator& btree::iterator::operator++() {
+
+	Slot++;
+	_load();
+	return *this;
+
+}
+
+
+btree::iterator btree::begin() const {
+
+	iterator it;
+	it.Tree = this;
+	_position("", LLONG_MIN, it.Page, it.Slot);
+	it._load();
+	return it;
+
+}
+
+
+// iterator to the first entry whose key is not less than key
+btree::iterator btree::lower_bound(string_view key) const {
+
+	iterator it;
+	it.Tree = this;
+	_position(key, LLONG_MIN, it.Page, it.Slot);
+	it._load();
+	return it;
+
+}
+
+
+// iterator to the first entry whose key is greater than key
+btree::iterator btree::upper_bound(string_view key) const {
+
+	iterator it;
+	it.Tree = this;
+	_position(key, LLONG_MAX, it.Page, it.Slot);
+	it._load();
+	return it;
+
+}
+
+
+// the positions of every record with this key, in file order; empty
+// if there are none.
+postinglist btree::search(const string& key) const {
+
+	postinglist postings;
+	for (iterator it = lower_bound(key); it != end() && it.key() == key; ++it) {
+		postings.push_back(it.value());
+	}
+	return postings;
+
+}
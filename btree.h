@@ -0,0 +1,136 @@
+#ifndef BTREE_H
+#define BTREE_H
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <functional>
+#include <cstdint>
+#include "postings.h"
+using namespace std;
+
+
+// Disk-resident B+tree index: column value -> file position, for tables
+// whose indexes don't fit in memory.  Nodes are 4KB pages in a file; only
+// a bounded number of pages are kept in memory, in an LRU page cache, so
+// the index can be far larger than RAM.  Duplicate keys are allowed: each
+// record is its own (key, position) entry, and entries are ordered by key
+// and then position, so a key's positions come back in file order.
+//
+// Offers the same operations as avltree --- insert, remove, search, size,
+// height and ordered iteration --- plus bulkload, which builds the whole tree
+// bottom-up from sorted entries.  The tree survives restarts: open() an
+// existing file and it is used as is.  Thread safe for concurrent readers;
+// the page cache is the only shared state and is locked per page access.
+class btree {
+
+public:
+
+	static const int PageSize = 4096;
+	static const int MaxKeySize = 1024;  // longer keys can't be indexed
+
+private:
+
+	struct ENTRY {
+		string    Key;
+		streamoff Value;
+		uint32_t  Child;  // internal pages: page holding entries >= this one
+	};
+
+	// one cached page; pages are numbered from 0 (the metadata page)
+	struct FRAME {
+		uint32_t Page;
+		bool     Dirty;
+		char     Data[PageSize];
+	};
+
+	int      File;        // file descriptor, -1 if closed
+	uint32_t Root;        // page # of the root (0 if empty)
+	int      Height;      // -1 if empty, 0 if the root is a leaf
+	int64_t  Size;        // # of entries
+	uint32_t NumPages;    // # of pages in the file
+	int64_t  Stamp[4];    // caller's data, e.g. which .data file the index is for
+
+	size_t                                       CachePages;  // most pages kept in memory
+	mutable list<FRAME>                          Frames;      // most recently used first
+	mutable unordered_map<uint32_t, list<FRAME>::iterator> Cached;
+	mutable mutex                                CacheLock;
+	mutable int64_t                              Hits, Misses;
+
+	char* _page(uint32_t page, bool dirty) const;
+	uint32_t _newpage(bool leaf);
+	bool _writemeta();
+	void _readentries(uint32_t page, vector<ENTRY>& entries, bool& leaf, uint32_t& link) const;
+	bool _writeentries(uint32_t page, const vector<ENTRY>& entries, bool leaf, uint32_t link);
+	bool _insert(uint32_t page, const ENTRY& entry, vector<ENTRY>& split);
+	void _position(string_view key, streamoff value, uint32_t& page, int& slot) const;
+	bool _entry(uint32_t page, int slot, string& key, streamoff& value, uint32_t& next) const;
+
+public:
+
+	// Ordered iterator over entries.  Holds a copy of the current entry,
+	// so it stays valid while other pages move through the cache.
+	class iterator {
+
+	private:
+
+		friend class btree;
+		const btree* Tree;
+		uint32_t     Page;   // 0 at the end
+		int          Slot;
+		string       Key;
+		streamoff    Value;
+
+		void _load();
+
+	public:
+
+		iterator() {	Tree = nullptr; Page = 0; Slot = 0; Value = 0;	}
+
+		const string& key() const      {	return Key;	}
+		streamoff     value() const    {	return Value;	}
+
+		iterator& operator++();
+		bool operator==(const iterator& other) const {	return Page == other.Page && (Page == 0 || Slot == other.Slot);	}
+		bool operator!=(const iterator& other) const {	return !(*this == other);	}
+
+	};
+
+	btree();
+	btree(const btree& other) = delete;
+	btree& operator=(const btree& other) = delete;
+	~btree();
+
+	bool open(string filename, size_t cachePages);
+	bool create(string filename, size_t cachePages);
+	void close();
+	bool flush();
+
+	void bulkload(vector<pair<string, streamoff>>& pairs);
+	bool insert(const string& key, streamoff value);
+	bool remove(const string& key, streamoff value);
+	postinglist search(const string& key) const;
+	void remap(const function<streamoff(streamoff)>& fn);
+
+	int64_t size() const  {	return Size;	}
+	int height() const    {	return Height;	}
+	uint32_t pages() const  {	return NumPages;	}
+	size_t cachePages() const  {	return CachePages;	}
+	int64_t cacheHits() const  {	return Hits;	}
+	int64_t cacheMisses() const  {	return Misses;	}
+
+	const int64_t* stamp() const  {	return Stamp;	}
+	void setStamp(int64_t a, int64_t b, int64_t c, int64_t d = 0);
+
+	iterator begin() const;
+	iterator end() const  {	return iterator();	}
+	iterator lower_bound(string_view key) const;
+	iterator upper_bound(string_view key) const;
+
+};
+
+#endif
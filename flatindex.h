@@ -0,0 +1,232 @@
+#ifndef FLATINDEX_H
+#define FLATINDEX_H
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include "avl.h"
+#include "postings.h"
+#include "keys.h"
+using namespace std;
+
+
+// The file positions for one key (or a run of keys) of a flatindex,
+// as a range usable like a postinglist.
+struct positionrange {
+
+	const streamoff* First;
+	const streamoff* Last;
+
+	const streamoff* begin() const  {	return First;	}
+	const streamoff* end() const    {	return Last;	}
+	size_t size() const  {	return Last - First;	}
+	bool   empty() const {	return First == Last;	}
+
+};
+
+
+// Read-only snapshot of an avl index, laid out for lookups instead of
+// updates.  freeze() copies the tree's keys into sorted arrays, and
+// 8 bytes of every key, packed big-endian into an integer so integer
+// order is string order, into an Eytzinger (breadth-first) array.  The
+// 8 bytes are taken after the prefix all keys share (e.g. "station_"),
+// so they tell keys apart as often as possible.  A search walks that
+// array with one integer compare per level, the turn taken computed
+// rather than branched on, and prefetches the 8 descendants three
+// levels down.  Only when two 8 byte prefixes tie does it branch to
+// compare the full keys.  Keys are then addressed by their sorted rank.
+class flatindex {
+
+private:
+
+	vector<uint64_t> Prefixes;   // Eytzinger order, 1-based; [0] unused
+	vector<size_t>   Rank;       // Eytzinger position -> sorted rank
+	vector<char>     KeyBytes;   // all keys back to back, sorted
+	vector<size_t>   KeyStart;   // rank -> start of key in KeyBytes; [size] is the end
+	vector<streamoff> Positions; // all posting lists back to back, by rank
+	vector<size_t>   PosStart;   // rank -> start of its positions; [size] is the end
+	size_t Size;                 // # of keys
+	string Common;               // prefix shared by every key, skipped by Prefixes
+
+
+	static uint64_t _prefix(string_view key) {
+
+		uint64_t prefix = 0;
+		for (size_t i = 0; i < 8; i++) {
+			prefix = (prefix << 8) | (i < key.size() ? (unsigned char) key[i] : 0);
+		}
+		return prefix;
+
+	}
+
+
+	// fills the Eytzinger array: an inorder walk of the implicit
+	// tree (children of k at 2k and 2k+1) visits ranks in order.
+	void _layout(size_t k, size_t& rank) {
+
+		if (k > Size) {
+			return;
+		}
+		_layout(2 * k, rank);
+		Prefixes[k] = _prefix(key(rank).substr(Common.size()));
+		Rank[k] = rank++;
+		_layout(2 * k + 1, rank);
+
+	}
+
+
+	// Eytzinger position of the first key not less than key (if
+	// orEqual is false) or greater than key (if true); 0 if none.
+	size_t _search(string_view key, bool orEqual) const {
+
+		// a key without the common prefix sorts before or after every key
+		int common = key.substr(0, Common.size()).compare(Common);
+		if (common != 0) {
+			return (common < 0 && Size > 0) ? _leftmost() : 0;
+		}
+
+		uint64_t prefix = _prefix(key.substr(Common.size()));
+		size_t k = 1;
+		while (k <= Size) {
+			__builtin_prefetch(Prefixes.data() + 8 * k);
+			uint64_t cur = Prefixes[k];
+			bool goRight = (cur < prefix) |
+				((cur == prefix) && (orEqual ? this->key(Rank[k]) <= key : this->key(Rank[k]) < key));
+			k = 2 * k + goRight;
+		}
+		CountStat(&querystats::NodesVisited, 63 - __builtin_clzll(k)); // levels walked
+		// undo the right turns taken after the last left turn
+		k >>= __builtin_ffsll(~k);
+		return k;
+
+	}
+
+	// Eytzinger position of the smallest key
+	size_t _leftmost() const {
+
+		size_t k = 1;
+		while (2 * k <= Size) {
+			k = 2 * k;
+		}
+		return k;
+
+	}
+
+public:
+
+	flatindex() {	Size = 0;	}
+
+
+	// replaces the snapshot with the current contents of tree.  Keys
+	// are stored as EncodeKey's bytes, so numbers keep their order.
+	template<typename TKey>
+	void freeze(const avltree<TKey, postinglist>& tree) {
+
+		Size = tree.size();
+		KeyBytes.clear();
+		KeyStart.clear();
+		Positions.clear();
+		PosStart.clear();
+		for (auto it = tree.begin(); it != tree.end(); ++it) {
+			auto&& key = EncodeKey(it.key());  // a string, or a view of a fieldkey's bytes
+			KeyStart.push_back(KeyBytes.size());
+			KeyBytes.insert(KeyBytes.end(), key.begin(), key.end());
+			PosStart.push_back(Positions.size());
+			Positions.insert(Positions.end(), it.value().begin(), it.value().end());
+		}
+		KeyStart.push_back(KeyBytes.size());
+		PosStart.push_back(Positions.size());
+
+		// the prefix all keys share is the one the smallest and largest share
+		Common.clear();
+		if (Size > 0) {
+			string_view first = key(0), last = key(Size - 1);
+			size_t length = 0;
+			while (length < first.size() && length < last.size() && first[length] == last[length]) {
+				length++;
+			}
+			Common = string(first.substr(0, length));
+		}
+
+		Prefixes.assign(Size + 1, 0);
+		Rank.assign(Size + 1, 0);
+		size_t rank = 0;
+		_layout(1, rank);
+
+	}
+
+
+	size_t size() const {	return Size;	}
+
+
+	// the key with the given sorted rank
+	string_view key(size_t rank) const {
+
+		return string_view(KeyBytes.data() + KeyStart[rank], KeyStart[rank + 1] - KeyStart[rank]);
+
+	}
+
+
+	// the positions of the key with the given sorted rank
+	positionrange positions(size_t rank) const {
+
+		return positionrange{ Positions.data() + PosStart[rank], Positions.data() + PosStart[rank + 1] };
+
+	}
+
+
+	// the positions of every key with rank in [first, last)
+	positionrange positions(size_t first, size_t last) const {
+
+		return positionrange{ Positions.data() + PosStart[first], Positions.data() + PosStart[last] };
+
+	}
+
+
+	// rank of the first key not less than key; size() if none
+	size_t lower_bound(string_view key) const {
+
+		size_t k = _search(key, false);
+		return (k == 0) ? Size : Rank[k];
+
+	}
+
+
+	// rank of the first key greater than key; size() if none
+	size_t upper_bound(string_view key) const {
+
+		size_t k = _search(key, true);
+		return (k == 0) ? Size : Rank[k];
+
+	}
+
+
+	// replaces every position p with fn(p).  fn must keep positions in
+	// order, as it does when a compaction closes the gaps left by
+	// deleted records.
+	template<typename Fn>
+	void remap(Fn fn) {
+
+		for (streamoff& pos : Positions) {
+			pos = fn(pos);
+		}
+
+	}
+
+
+	// the positions of key's records; empty if key is not indexed
+	positionrange find(string_view key) const {
+
+		size_t rank = lower_bound(key);
+		if (rank == Size || this->key(rank) != key) {
+			return positionrange{ nullptr, nullptr };
+		}
+		return positions(rank);
+
+	}
+
+};
+
+#endif
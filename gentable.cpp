@@ -0,0 +1,68 @@
+#include <iostream>
+#include <string>
+#include <sstream>
+#include <cstdlib>
+#include "synthetic.h"
+using namespace std;
+
+
+// usage: gentable.exe tablename [--rows N] [--columns N] [--distinct N]
+//                    [--dist uniform|zipf|sequential] [--index c,c,...|none]
+//                    [--kind avl|btree|hash] [--seed N]
+// writes a synthetic "tablename.data" and "tablename.meta" (see
+// synthetic.h) for trying out program.exe at any size: --rows records
+// (default 10000) of --columns values (default 4), each column but id
+// drawn from --distinct values (default: as many as rows) by --dist.
+// --index lists the columns to index (default 0, the id), with the
+// index type given by --kind (default avl).
+int main(int argc, char* argv[]) {
+
+	if (argc < 2) {
+		cout << "usage: gentable.exe tablename [--rows N] [--columns N] [--distinct N]" << endl;
+		cout << "         [--dist uniform|zipf|sequential] [--index c,c,...|none] [--kind avl|btree|hash] [--seed N]" << endl;
+		return 1;
+	}
+	tablespec spec;
+	spec.Name = argv[1];
+	spec.Indexed = { 0 };
+	for (int i = 2; i < argc; i++) {
+		string arg = argv[i];
+		if (arg == "--rows" && i + 1 < argc) {
+			spec.Rows = atoll(argv[++i]);
+		}
+		else if (arg == "--columns" && i + 1 < argc) {
+			spec.Columns = atoi(argv[++i]);
+		}
+		else if (arg == "--distinct" && i + 1 < argc) {
+			spec.Distinct = atoll(argv[++i]);
+		}
+		else if (arg == "--dist" && i + 1 < argc) {
+			spec.Distribution = argv[++i];
+		}
+		else if (arg == "--index" && i + 1 < argc) {
+			spec.Indexed.clear();
+			stringstream list(argv[++i]);
+			string column;
+			while (getline(list, column, ',')) {
+				if (column != "none") {
+					spec.Indexed.push_back(atoi(column.c_str()));
+				}
+			}
+		}
+		else if (arg == "--kind" && i + 1 < argc) {
+			string kind = argv[++i];
+			spec.IndexKind = (kind == "avl") ? "1" : kind;
+		}
+		else if (arg == "--seed" && i + 1 < argc) {
+			spec.Seed = atoi(argv[++i]);
+		}
+	}
+
+	if (!WriteTable(spec, cout)) {
+		return 1;
+	}
+	cout << "Wrote " << spec.Rows << " records of " << spec.Columns << " columns to "
+	<< spec.Name << ".data and " << spec.Name << ".meta" << endl;
+	return 0;
+
+}
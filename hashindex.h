@@ -0,0 +1,193 @@
+#ifndef HASHINDEX_H
+#define HASHINDEX_H
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include "avl.h"
+#include "postings.h"
+#include "flatindex.h"
+#include "keys.h"
+using namespace std;
+
+
+// Equality-only index: an open-addressing hash table from key to the
+// key's positions.  Slots are one flat array probed linearly from the
+// key's home slot, and each holds the key's full 64-bit hash, so a probe
+// only compares key bytes when the hashes are equal.  The table is kept
+// at most half full, which keeps probe sequences to a slot or two.
+// Built once from an avl index, like flatindex; it can't answer ranges.
+class hashindex {
+
+private:
+
+	static const uint32_t Empty = UINT32_MAX;
+
+	struct SLOT {
+		uint64_t Hash;
+		uint32_t Key;  // key number, Empty if unused
+	};
+
+	vector<SLOT>      Slots;      // size is a power of two
+	uint64_t          Mask;       // Slots.size() - 1
+	int               Shift;      // 64 - log2(Slots.size())
+	vector<char>      KeyBytes;   // all keys back to back
+	vector<uint32_t>  KeyStart;   // key number -> start of key in KeyBytes; [size] is the end
+	vector<streamoff> Positions;  // all posting lists back to back, by key number
+	vector<uint32_t>  PosStart;   // key number -> start of its positions; [size] is the end
+	size_t            Size;       // # of keys
+
+
+	// FNV-1a; the home slot is the top bits of the hash times 2^64 / phi
+	// (Fibonacci hashing), which mixes every bit of the hash into them
+	static uint64_t _hash(string_view key) {
+
+		uint64_t hash = 14695981039346656037ULL;
+		for (char c : key) {
+			hash = (hash ^ (unsigned char) c) * 1099511628211ULL;
+		}
+		return hash;
+
+	}
+
+	size_t _home(uint64_t hash) const {
+
+		return (hash * 0x9E3779B97F4A7C15ULL) >> Shift;
+
+	}
+
+	string_view _key(uint32_t number) const {
+
+		return string_view(KeyBytes.data() + KeyStart[number], KeyStart[number + 1] - KeyStart[number]);
+
+	}
+
+public:
+
+	hashindex() {	Mask = 0; Shift = 64; Size = 0;	}
+
+
+	// replaces the table with the current contents of tree.  Keys are
+	// stored, and looked up, as EncodeKey's bytes.
+	template<typename TKey>
+	void build(const avltree<TKey, postinglist>& tree) {
+
+		Size = tree.size();
+		KeyBytes.clear();
+		KeyStart.clear();
+		Positions.clear();
+		PosStart.clear();
+
+		size_t numSlots = 16;
+		Shift = 60;
+		while (numSlots < 2 * Size) {
+			numSlots *= 2;
+			Shift--;
+		}
+		Slots.assign(numSlots, SLOT{ 0, Empty });
+		Mask = numSlots - 1;
+
+		uint32_t number = 0;
+		for (auto it = tree.begin(); it != tree.end(); ++it, ++number) {
+			auto&& key = EncodeKey(it.key());  // a string, or a view of a fieldkey's bytes
+			KeyStart.push_back(KeyBytes.size());
+			KeyBytes.insert(KeyBytes.end(), key.begin(), key.end());
+			PosStart.push_back(Positions.size());
+			Positions.insert(Positions.end(), it.value().begin(), it.value().end());
+
+			uint64_t hash = _hash(key);
+			size_t slot = _home(hash);
+			while (Slots[slot].Key != Empty) {
+				slot = (slot + 1) & Mask;
+			}
+			Slots[slot] = SLOT{ hash, number };
+		}
+		KeyStart.push_back(KeyBytes.size());
+		PosStart.push_back(Positions.size());
+
+	}
+
+
+	size_t size() const      {	return Size;	}
+	size_t capacity() const  {	return Slots.size();	}
+	double loadFactor() const  {	return Slots.empty() ? 0 : (double) Size / Slots.size();	}
+
+
+	// the positions of key's records; empty if key is not indexed
+	positionrange find(string_view key) const {
+
+		if (Size == 0) {
+			return positionrange{ nullptr, nullptr };
+		}
+		uint64_t hash = _hash(key);
+		int64_t probes = 1;
+		for (size_t slot = _home(hash); Slots[slot].Key != Empty; slot = (slot + 1) & Mask, probes++) {
+			if (Slots[slot].Hash == hash && _key(Slots[slot].Key) == key) {
+				CountStat(&querystats::NodesVisited, probes);
+				uint32_t number = Slots[slot].Key;
+				return positionrange{ Positions.data() + PosStart[number], Positions.data() + PosStart[number + 1] };
+			}
+		}
+		CountStat(&querystats::NodesVisited, probes);
+		return positionrange{ nullptr, nullptr };
+
+	}
+
+
+	// same as flatindex::remap
+	template<typename Fn>
+	void remap(Fn fn) {
+
+		for (streamoff& pos : Positions) {
+			pos = fn(pos);
+		}
+
+	}
+
+
+	// rebuilds tree, the index this table was built from, so it can be
+	// changed again.  makeKey(bytes, positions) gives the tree's key for
+	// a key's bytes and positions.  Keys were numbered in the tree's
+	// order, so they are bulk loaded as they are.
+	template<typename TKey, typename Fn>
+	void thaw(avltree<TKey, postinglist>& tree, Fn makeKey) const {
+
+		vector<pair<TKey, postinglist>> pairs;
+		pairs.reserve(Size);
+		for (uint32_t number = 0; number < Size; number++) {
+			positionrange positions{ Positions.data() + PosStart[number], Positions.data() + PosStart[number + 1] };
+			pairs.push_back(make_pair(makeKey(_key(number), positions), postinglist()));
+			for (streamoff pos : positions) {
+				pairs.back().second.push_back(pos);
+			}
+		}
+		tree.bulkload(pairs);
+
+	}
+
+
+	// probe lengths of successful lookups: the # of slots looked at to
+	// find each key, averaged over all keys, and the longest.
+	void probeStats(double& average, size_t& longest) const {
+
+		size_t total = 0;
+		longest = 0;
+		for (size_t slot = 0; slot < Slots.size(); slot++) {
+			if (Slots[slot].Key == Empty) {
+				continue;
+			}
+			size_t length = ((slot - _home(Slots[slot].Hash)) & Mask) + 1;
+			total += length;
+			if (length > longest) {
+				longest = length;
+			}
+		}
+		average = (Size == 0) ? 0 : (double) total / Size;
+
+	}
+
+};
+
+#endif
@@ -0,0 +1,44 @@
+#include <iostream>
+#include <string>
+#include <chrono>
+#include "util.h"
+#include "table.h"
+using namespace std;
+
+
+// usage: import.exe tablename
+// converts "tablename.data" into the typed columnar "tablename.col",
+// using the column types declared in "tablename.meta" (e.g. capacity:int).
+// program.exe then scans the .col file instead of the .data file, for as
+// long as the .data file is unchanged; rerun import after changing it.
+int main(int argc, char* argv[]) {
+
+	if (argc != 2) {
+		cout << "usage: import.exe tablename" << endl;
+		return 1;
+	}
+	string tablename = argv[1];
+
+	dbtable table;
+	if (!table.open(tablename)) {
+		return 1;
+	}
+
+	auto start = chrono::steady_clock::now();
+	string filename = tablename + ".col";
+	if (!SaveColumns(filename, table.data(), table.columnTypes(), cout)) {
+		return 1;
+	}
+	chrono::duration<double, milli> time = chrono::steady_clock::now() - start;
+
+	columnfile columns;
+	if (!columns.open(tablename, table.data(), table.columnTypes())) {
+		cout << "**Error: couldn't read back column file '" << filename << "'." << endl;
+		return 1;
+	}
+	cout << "Imported " << columns.numRows() << " records in " << time.count() << " ms" << endl;
+	cout << "  " << tablename << ".data: " << table.data().length() << " bytes" << endl;
+	cout << "  " << filename << ": " << columns.length() << " bytes" << endl;
+	return 0;
+
+}
@@ -0,0 +1,188 @@
+#ifndef KEYS_H
+#define KEYS_H
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <charconv>
+#include <cstring>
+#include <cstdint>
+using namespace std;
+
+
+// Index keys.  An index on an int or double column (typed in .meta)
+// keys its avl tree by int64_t or double, so a key sits inline in its
+// node, compares in one instruction, and ranges go in numeric order.
+// A string column's avl tree is keyed by fieldkey, a view of the value
+// in the mapped .data file.  Everywhere keys are bytes instead ---
+// flatindex and hashindex snapshots, B+tree pages, .idx files --- a
+// number is stored as the 8 bytes EncodeKey gives it, whose byte order
+// is the numbers' order, so comparing the bytes compares the numbers; a
+// string is itself.
+
+
+// A string key that doesn't own its bytes: a view of them, which in an
+// index is the value in a record of the mapped .data file, so the key
+// isn't a second copy of it.  The first 4 bytes are kept inline too, so
+// comparing keys that differ in them never reads the file.  16 bytes,
+// where a string is 32 and, past 15 characters, a heap block more.
+class fieldkey {
+
+private:
+
+	const char* Bytes;
+	uint32_t    Length;
+	uint32_t    Prefix;  // first 4 bytes, most significant first, zero padded
+
+public:
+
+	fieldkey() {	Bytes = ""; Length = 0; Prefix = 0;	}
+
+	explicit fieldkey(string_view text) {
+
+		Bytes = text.data();
+		Length = text.size();
+		Prefix = 0;
+		for (size_t i = 0; i < 4; i++) {
+			Prefix = (Prefix << 8) | (i < text.size() ? (unsigned char) text[i] : 0);
+		}
+
+	}
+
+	const char* data() const  {	return Bytes;	}
+	size_t      size() const  {	return Length;	}
+	operator string_view() const  {	return string_view(Bytes, Length);	}
+
+	// points the key at another copy of its bytes, e.g. where the
+	// mapping of the .data file has moved
+	void rebase(const char* bytes)  {	Bytes = bytes;	}
+
+	bool operator<(const fieldkey& other) const {
+		if (Prefix != other.Prefix) {
+			return Prefix < other.Prefix;
+		}
+		return string_view(*this) < string_view(other);
+	}
+	bool operator==(const fieldkey& other) const {
+		return Prefix == other.Prefix && Length == other.Length && memcmp(Bytes, other.Bytes, Length) == 0;
+	}
+	bool operator!=(const fieldkey& other) const  {	return !(*this == other);	}
+	bool operator>(const fieldkey& other) const   {	return other < *this;	}
+	bool operator<=(const fieldkey& other) const  {	return !(other < *this);	}
+	bool operator>=(const fieldkey& other) const  {	return !(*this < other);	}
+
+};
+
+
+// parses text as a key; false if it isn't one of the key's type
+inline bool ParseKey(string_view text, string& key) {
+
+	key.assign(text.data(), text.size());
+	return true;
+
+}
+
+inline bool ParseKey(string_view text, fieldkey& key) {
+
+	key = fieldkey(text);
+	return true;
+
+}
+
+inline bool ParseKey(string_view text, int64_t& key) {
+
+	const char* end = text.data() + text.size();
+	from_chars_result result = from_chars(text.data(), end, key);
+	return result.ec == errc() && result.ptr == end;
+
+}
+
+inline bool ParseKey(string_view text, double& key) {
+
+	const char* end = text.data() + text.size();
+	from_chars_result result = from_chars(text.data(), end, key);
+	if (result.ec != errc() || result.ptr != end || key != key) { // NaN has no place in the order
+		return false;
+	}
+	key += 0.0; // -0 becomes 0, so the two are one key
+	return true;
+
+}
+
+
+// 8 bytes, most significant first, of a number whose unsigned order is
+// the key's order
+inline string _keyBytes(uint64_t bits) {
+
+	string bytes(8, '\0');
+	for (int i = 7; i >= 0; i--) {
+		bytes[i] = (char) (bits & 0xFF);
+		bits >>= 8;
+	}
+	return bytes;
+
+}
+
+inline uint64_t _keyBits(string_view bytes) {
+
+	uint64_t bits = 0;
+	for (size_t i = 0; i < 8 && i < bytes.size(); i++) {
+		bits = (bits << 8) | (unsigned char) bytes[i];
+	}
+	return bits;
+
+}
+
+
+// key as bytes that compare (as strings) the way the keys do
+inline const string& EncodeKey(const string& key) {
+
+	return key;
+
+}
+
+inline string_view EncodeKey(const fieldkey& key) {
+
+	return key;
+
+}
+
+inline string EncodeKey(int64_t key) {
+
+	return _keyBytes((uint64_t) key ^ (1ULL << 63)); // flipping the sign bit puts negatives first
+
+}
+
+inline string EncodeKey(double key) {
+
+	uint64_t bits;
+	memcpy(&bits, &key, sizeof(bits));
+	// negatives: all bits flipped, so larger magnitudes come first;
+	// positives: the sign bit set, so they come after every negative
+	return _keyBytes((bits >> 63) ? ~bits : bits | (1ULL << 63));
+
+}
+
+
+// the key EncodeKey made bytes from
+inline void DecodeKey(string_view bytes, string& key) {
+
+	key.assign(bytes.data(), bytes.size());
+
+}
+
+inline void DecodeKey(string_view bytes, int64_t& key) {
+
+	key = (int64_t) (_keyBits(bytes) ^ (1ULL << 63));
+
+}
+
+inline void DecodeKey(string_view bytes, double& key) {
+
+	uint64_t bits = _keyBits(bytes);
+	bits = (bits >> 63) ? bits & ~(1ULL << 63) : ~bits;
+	memcpy(&key, &bits, sizeof(key));
+
+}
+
+#endif
@@ -0,0 +1,153 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+using namespace std;
+
+
+// connects to the server's Unix domain socket; -1 on failure
+int connectTo(const string& socketPath) {
+
+	sockaddr_un address = {};
+	address.sun_family = AF_UNIX;
+	if (socketPath.size() >= sizeof(address.sun_path)) {
+		return -1;
+	}
+	socketPath.copy(address.sun_path, socketPath.size());
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd >= 0 && connect(fd, (sockaddr*) &address, sizeof(address)) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+
+}
+
+
+// one client: sends numQueries queries, taken in turn from queries
+// starting at first, one at a time, waiting for each one's results (they
+// end with a blank line).  Adds each query's latency, in microseconds, to
+// latencies.  Returns false if the server went away.
+bool runClient(const string& socketPath, const vector<string>& queries, size_t first, int numQueries,
+			vector<double>& latencies) {
+
+	int fd = connectTo(socketPath);
+	if (fd < 0) {
+		return false;
+	}
+	string response;
+	char chunk[65536];
+	bool ok = true;
+	for (int i = 0; i < numQueries && ok; i++) {
+		string query = queries[(first + i) % queries.size()] + "\n";
+		auto start = chrono::steady_clock::now();
+		if (write(fd, query.data(), query.size()) != (ssize_t) query.size()) {
+			ok = false;
+			break;
+		}
+		response.clear();
+		while (response.size() < 2 || response.compare(response.size() - 2, 2, "\n\n") != 0) {
+			ssize_t received = read(fd, chunk, sizeof(chunk));
+			if (received <= 0) {
+				ok = false;
+				break;
+			}
+			response.append(chunk, received);
+		}
+		if (!ok) { // a partial response's latency is no latency
+			break;
+		}
+		chrono::duration<double, micro> latency = chrono::steady_clock::now() - start;
+		latencies.push_back(latency.count());
+	}
+	write(fd, "exit\n", 5);
+	close(fd);
+	return ok;
+
+}
+
+
+// usage: loadgen.exe socket queryfile [--clients N] [--queries N]
+// load generator for program.exe --serve: runs --clients concurrent
+// clients (default 8), each sending --queries queries (default 10000)
+// from queryfile (one per line, reused round robin) one at a time, and
+// reports total throughput and latency percentiles.
+int main(int argc, char* argv[]) {
+
+	if (argc < 3) {
+		cout << "usage: loadgen.exe socket queryfile [--clients N] [--queries N]" << endl;
+		return 1;
+	}
+	string socketPath = argv[1];
+	int numClients = 8;
+	int numQueries = 10000;
+	for (int i = 3; i < argc; i++) {
+		string arg = argv[i];
+		if (arg == "--clients" && i + 1 < argc) {
+			numClients = max(1, atoi(argv[++i]));
+		}
+		else if (arg == "--queries" && i + 1 < argc) {
+			numQueries = max(1, atoi(argv[++i]));
+		}
+	}
+
+	vector<string> queries;
+	ifstream in(argv[2]);
+	string line;
+	while (getline(in, line)) {
+		if (!line.empty() && line != "exit") {
+			queries.push_back(line);
+		}
+	}
+	if (queries.empty()) {
+		cout << "**Error: no queries in '" << argv[2] << "'." << endl;
+		return 1;
+	}
+
+	signal(SIGPIPE, SIG_IGN); // a server that goes away fails a write instead of killing us
+
+	// each client starts at a different query, so they don't move in step
+	vector<vector<double>> latencies(numClients);
+	vector<char> ok(numClients);
+	vector<thread> clients;
+	auto start = chrono::steady_clock::now();
+	for (int c = 0; c < numClients; c++) {
+		clients.emplace_back([&, c]() {
+			ok[c] = runClient(socketPath, queries, c * queries.size() / numClients, numQueries, latencies[c]);
+		});
+	}
+	for (thread& client : clients) {
+		client.join();
+	}
+	chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+	vector<double> all;
+	for (int c = 0; c < numClients; c++) {
+		if (!ok[c]) {
+			cout << "**Error: client " << c << " lost its connection to '" << socketPath << "'." << endl;
+		}
+		all.insert(all.end(), latencies[c].begin(), latencies[c].end());
+	}
+	if (all.empty()) {
+		return 1;
+	}
+	sort(all.begin(), all.end());
+	auto percentile = [&](double p) {	return all[min(all.size() - 1, (size_t) (all.size() * p))];	};
+	cout << "Clients: " << numClients << ", queries: " << all.size() << '\n';
+	cout << "  Throughput: " << all.size() / elapsed.count() << " queries/sec" << '\n';
+	cout << "  Latency p50: " << percentile(0.50) << " us" << '\n';
+	cout << "  Latency p99: " << percentile(0.99) << " us" << '\n';
+	cout << "  Latency p99.9: " << percentile(0.999) << " us" << '\n';
+	cout << "  Latency max: " << all.back() << " us" << endl;
+	return 0;
+
+}
@@ -4,420 +4,630 @@
 #include <string>
 #include <sstream>
 #include <cassert>
+#include <chrono>
+#include <thread>
+#include <cstdlib>
+#include <algorithm>
+#include <csignal>
+#include <atomic>
+#include <shared_mutex>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "avl.h"
 #include "util.h"
+#include "table.h"
+#include "query.h"
+#include "stats.h"
 using namespace std;
 
 
-// given a string, breaks the string into individual tokens (words) based
-// on spaces between the tokens.  Returns the tokens back in a vector.
-// Example: "select * from students" would be tokenized into a vector
-// containing 4 strings:  "select", "*", "from", "students".
-vector<string> tokenize(string line) {
+// print avl information
+void printAvlInfo(const dbtable& table) {
 
-	vector<string> tokens;
-	stringstream  stream(line);
-	string token;
+	const vector<string>& indexVector = table.indexVector();
+	const vector<keyindex>& avlVector = table.avlVector();
 
-	while (getline(stream, token, ' ')) {
-		tokens.push_back(token);
+	for (unsigned i = 0; i < indexVector.size(); i++ ) {
+		cout << "Index column: "
+		<< indexVector[i]
+		<< endl;
+		if (table.indexKind(i) == "hash") { // hash table: no height, report how full and probe lengths
+			const hashindex& hash = table.hashVector()[i];
+			double averageProbe;
+			size_t longestProbe;
+			hash.probeStats(averageProbe, longestProbe);
+			cout << "  Hash size: "
+			<< hash.size()
+			<< endl;
+			cout << "  Hash load factor: "
+			<< hash.loadFactor()
+			<< " ("
+			<< hash.capacity()
+			<< " slots)"
+			<< endl;
+			cout << "  Hash probe length: "
+			<< averageProbe
+			<< " avg, "
+			<< longestProbe
+			<< " max"
+			<< endl;
+		}
+		else if (table.indexKind(i) == "btree") { // B+tree: entries are records, not distinct keys
+			const btree& tree = table.btreeIndex(i);
+			cout << "  B+tree entries: "
+			<< tree.size()
+			<< endl;
+			cout << "  B+tree height: "
+			<< tree.height()
+			<< endl;
+			cout << "  B+tree pages: "
+			<< tree.pages()
+			<< " (cache: "
+			<< tree.cachePages()
+			<< ")"
+			<< endl;
+		}
+		else {
+			cout << "  Tree size: "
+			<< avlVector[i].size()
+			<< endl;
+			cout << "  Tree height: "
+			<< avlVector[i].height()
+			<< endl;
+		}
 	}
-	return tokens;
 
 }
 
 
-// given the meta filename, return a vector with all data in file
-vector<string> createMetaVector(string tablename) {
-
-	vector<string> metaVector;
-	// open the file, make sure it opened, seekg to the given position,
-	// loop and input values using >>, store into vector, return vector
-	string filename = tablename + ".meta";
-	ifstream data(filename, ios::in | ios::binary);
-
-	if (!data.good()) {
-		cout << "**Error: couldn't open data file '" << filename << "'." << endl;
-		return metaVector;
-	}
+// print record cache hits and misses, on exit
+void printCacheInfo(const dbtable& table) {
 
-	// input all data from .meta to value
-	// then, store .meta data into vector
-	string value;
-	data >> value;
-	while (!data.eof()) {
-		metaVector.push_back(value);
-		data >> value;
+	const recordcache& cache = table.recordCache();
+	if (cache.capacity() == 0) {
+		return;
 	}
-	return metaVector;
+	cout << "Record cache: "
+	<< cache.hits()
+	<< " hits, "
+	<< cache.misses()
+	<< " misses"
+	<< endl;
 
 }
 
 
-// populate tree with data with index column as key and line position of record as value
-void populateAvlTree(string tablename, int recordSize, int numColumns, int indexVal, avltree<string, streamoff> &tree) {
+// query stats: collected while StatsOn (--stats, or "stats on"), and
+// summed over every query, from every client of a server
+static atomic<bool> StatsOn(false);
+static statstotals  StatsTotals;
 
-	string   filename = tablename + ".data";
-	ifstream data(filename, ios::in | ios::binary);
-	if (!data.good()) {
-		cout << "**Error: couldn't open data file '" << filename << "'." << endl;
-		return;
-	}
 
-	// okay, read file record by record, and insert each value into tree:
-	data.seekg(0, data.end);  // move to the end to get length of file:
-	streamoff length = data.tellg();
+// the stats commands: "stats" prints the totals so far, "stats on" and
+// "stats off" start and stop collecting them.  Returns false if text
+// isn't one.
+bool runStatsCommand(const string& text, ostream& out) {
 
-	streamoff pos = 0;  // first record at offset 0:
-	string    value;
-
-	while (pos < length) {
-		data.seekg(pos, data.beg);  // move to start of record:
-		for (int i = 0; i < numColumns; ++i) { // read values, one per column
-			data >> value;
-			if (i == indexVal) { // insert into tree appropriate value and key pair
-				tree.insert(value, pos);
-			}
+	if (text == "stats on") {
+		StatsOn = true;
+		out << "Stats on." << '\n';
+	}
+	else if (text == "stats off") {
+		StatsOn = false;
+		out << "Stats off." << '\n';
+	}
+	else if (text == "stats") {
+		if (!StatsOn) {
+			out << "Stats are off, \"stats on\" starts collecting them." << '\n';
 		}
-		pos += recordSize;  // move offset to start of next record:
+		StatsTotals.print(out);
 	}
+	else {
+		return false;
+	}
+	return true;
 
 }
 
 
-// checks if there are errors in input and outputs appropriate message
-// returns if input is valid or not
-bool errorCheck(string tablename, vector<string> tokens, vector<string> columnVector) {
-
-	// error checking...
-	bool valid = true;
-	if (tokens[0] != "select" && tokens[0] != "exit") {
-		valid = false;
-		cout << "Unknown query, ignored..." 
-		<< endl;
-	}
-	else if (tokens[0] == "select" && tokens[1] != "*") {
-		valid = false;
-		for (unsigned i = 0; i < columnVector.size(); i++) {
-			if (tokens[1] == columnVector[i]) {
-				valid = true;
-				break;
-			}
-		}
-		if (valid == false) {
-			cout << "Invalid select column, ignored..."
-			<< endl;
-		}
-	}
-	else if (tokens[2] != "from") {
-		valid = false;
-		cout << "Invalid select query, ignored..."
-		<< endl;
+// runs one query and writes its results to out, followed by a blank
+// line.  The query is only parsed if plans hasn't seen its shape before.
+// "explain select ..." prints the query's plan instead of running it.
+// Selects hold the table's lock shared, so they run alongside each
+// other but not while a write changes the table.  Taking it shared is
+// not free: every select, on every thread, updates the one lock word,
+// whose cache line then moves between cores, a cost that grows with the
+// threads doing short lookups at once.
+void runQuery(plancache& plans, const string& text, vector<string_view>& dataRecord, ostream& out) {
+
+	if (text.compare(0, 8, "explain ") == 0) {
+		shared_lock<shared_mutex> reader(plans.table().lock());
+		ExplainQuery(plans.table(), plans.prepare(string_view(text).substr(8)), out);
+		out << '\n';
+		return;
 	}
-	else if (tokens[3] != tablename) {
-		valid = false;
-		cout << "Invalid table name, ignored..."
-		<< endl;
+	if (runStatsCommand(text, out)) {
+		out << '\n';
+		return;
 	}
-	else if (tokens[4] != "where") {
-		valid = false;
-		cout << "Invalid select query, ignored..."
-		<< endl;
+
+	const query& q = plans.prepare(text);
+
+	// no error found
+	if (q.Valid && q.Kind != query::Select) {
+		WriteRecords(plans.table(), q, out);
 	}
-	else if (tokens[5] != "") {
-		valid = false;
-		for (unsigned i = 0; i < columnVector.size(); i++) {
-			if (tokens[5] == columnVector[i]) {
-				valid = true;
-				break;
-			}
-		}
-		if (valid == false) {
-			cout << "Invalid where column, ignored..."
-			<< endl;
-		}
+	else if (q.Valid && StatsOn) {
+		shared_lock<shared_mutex> reader(plans.table().lock());
+		querystats stats;
+		QueryStats = &stats;
+		auto start = chrono::steady_clock::now();
+		SelectRecords(plans.table(), q, dataRecord, out);
+		chrono::duration<double, micro> time = chrono::steady_clock::now() - start;
+		QueryStats = nullptr;
+		StatsTotals.add(stats, time.count());
 	}
-	else if (tokens[6] != "=") {
-		valid = false;
-		cout << "Invalid select query, ignored..."
-		<< endl;
+	else if (q.Valid) {
+		shared_lock<shared_mutex> reader(plans.table().lock());
+		SelectRecords(plans.table(), q, dataRecord, out);
 	}
-	else if (tokens.size() != 8) {
-		valid = false;
-		cout << "Invalid select query, ignored..."
-		<< endl;
+	else {
+		out << q.Error
+		<< '\n';
 	}
-	return valid;
+	out << '\n';
 
 }
 
 
-// print avl information
-void printAvlInfo(vector<string> indexVector, vector<avltree<string, streamoff>> avlVector) {
+// runs every query from in without prompting, until "exit" or the end
+// of input.  Results are gathered in a large block and written out a
+// block at a time rather than flushed per line.  Ends with a summary of
+// throughput and per-query latency.
+void runBatch(plancache& plans, istream& in, vector<string_view>& dataRecord) {
 
-	for (unsigned i = 0; i < indexVector.size(); i++ ) {
-		cout << "Index column: "
-		<< indexVector[i]
-		<< endl;
-		cout << "  Tree size: "
-		<< avlVector[i].size()
-		<< endl;
-		cout << "  Tree height: "
-		<< avlVector[i].height()
-		<< endl;
-	}
+	const size_t BlockSize = 1 << 20; // write results out in 1MB blocks
+	ostringstream block;
+	vector<double> latencies; // per query, in microseconds
 
-}
+	string query;
+	auto batchStart = chrono::steady_clock::now();
+	while (getline(in, query) && query != "exit") {
 
+		auto queryStart = chrono::steady_clock::now();
+		runQuery(plans, query, dataRecord, block);
+		chrono::duration<double, micro> queryTime = chrono::steady_clock::now() - queryStart;
+		latencies.push_back(queryTime.count());
 
-// go through both vectors, avl and linear until whereColumn and whereData is found, output not found otherwise
-// then print all inforation related to whereColumn and whereData
-void selectAll(string tablename, int offset, int numColumns, vector<string> tokens, vector<string> columnVector, 
-			vector<string> indexVector, vector<avltree<string, streamoff>> avlVector, vector<string> linearVector) {
+		if ((size_t) block.tellp() >= BlockSize) {
+			cout << block.str();
+			block.str("");
+		}
 
-	bool found = false;
-	string whereColumn = tokens[5];
-	string whereData = tokens[7];
+	}
+	cout << block.str() << flush;
+	chrono::duration<double> batchTime = chrono::steady_clock::now() - batchStart;
+
+	// throughput summary
+	cout << "Queries: " << latencies.size() << '\n';
+	if (!latencies.empty()) {
+		sort(latencies.begin(), latencies.end());
+		cout << "  Throughput: " << latencies.size() / batchTime.count() << " queries/sec" << '\n';
+		cout << "  Latency p50: " << latencies[latencies.size() / 2] << " us" << '\n';
+		cout << "  Latency p99: " << latencies[min(latencies.size() - 1, latencies.size() * 99 / 100)] << " us" << '\n';
+	}
+	cout << flush;
 
-	// check if column is indexed
-	for (unsigned i = 0; i < indexVector.size(); i++) {
+}
 
-		if (whereColumn == indexVector[i]) { // indexed column
 
-			streamoff *dataPos = avlVector[i].search(whereData);
-			if (dataPos == nullptr) { // whereData does not exist
-				break;
-			}
-			found = true;
-			vector<string> dataRecord;
-			dataRecord = GetRecord(tablename, *dataPos, numColumns);
-			
-			// print record data
-			for (unsigned j = 0; j < columnVector.size(); j++) {
-				cout << columnVector[j]
-				<< ": "
-				<< dataRecord[j]
-				<< endl;
-			}
+// one client of the server.  The poll loop in runServer owns it, except
+// while Busy, when a worker is running its queries and owns Plans,
+// DataRecord and Out.  A client's queries run on one worker at a time,
+// so its plancache needs no lock.
+struct connection {
 
-		}
+	int                 Fd;
+	string              Pending;   // received and not yet run: at most part of a line, unless Busy
+	bool                Busy;      // a worker is running its queries
+	bool                Closing;   // set by the worker: the client sent "exit", or couldn't be written to
+	plancache           Plans;
+	vector<string_view> DataRecord;
+	ostringstream       Out;
 
-	}
+	connection(dbtable& table, int fd) : Plans(table) {	Fd = fd; Busy = false; Closing = false;	}
 
-	if (found == false) {
+};
 
-		// check if column is not-indexed
-		for (unsigned i = 0; i < linearVector.size(); i++) {
 
-			if (whereColumn == linearVector[i]) {
+// longest part of a line the server keeps waiting for the rest of; a
+// client that sends more without a newline is disconnected
+const size_t MaxQueryLength = 1 << 16;
 
-				int matchColumn = 0;
-				// find the matchColumn integer for LinearSearch function
-				for (unsigned j = 0; j < columnVector.size(); j++) {
-					if (whereColumn == columnVector[j]) {
-						matchColumn = j + 1;
-						break;
-					}
-				}
-				vector<streamoff> dataPosVector = LinearSearch(tablename, offset, numColumns, whereData, matchColumn);
-				if (dataPosVector.empty()) { // whereData does not exist
-					break;
-				}
-				found = true;
-				vector<string> dataRecord;
-
-				// loop through all position of records given by linear search
-				// then, create a record vector for each line found
-				// finally, print the all data for each record line
-				for (unsigned k = 0; k < dataPosVector.size(); k++) {
-
-					dataRecord = GetRecord(tablename, dataPosVector[k], numColumns);
-					for (unsigned j = 0; j < columnVector.size(); j++) {
-						cout << columnVector[j]
-						<< ": "
-						<< dataRecord[j]
-						<< endl;
-					}
 
-				}
-
-			}
+// runs lines, complete lines a client sent, one query per line, and
+// sends their results back in one write, in the same form as batch
+// mode's, each query's ending with a blank line.  Returns false if the
+// client is done: it sent "exit", or couldn't be written to.
+bool serveLines(connection& client, const string& lines) {
 
+	bool more = true;
+	size_t start = 0, newline;
+	while ((newline = lines.find('\n', start)) != string::npos) {
+		string query = lines.substr(start, newline - start);
+		start = newline + 1;
+		if (!query.empty() && query.back() == '\r') {
+			query.pop_back();
 		}
-
+		if (query == "exit") {
+			more = false;
+			break;
+		}
+		runQuery(client.Plans, query, client.DataRecord, client.Out);
 	}
-	if (found == false) { // not found in both vectors
-		cout << "Not found..."
-		<< endl;
+
+	string results = client.Out.str();
+	client.Out.str("");
+	for (size_t sent = 0; sent < results.size(); ) {
+		ssize_t n = write(client.Fd, results.data() + sent, results.size() - sent);
+		if (n <= 0) {
+			return false;
+		}
+		sent += n;
 	}
+	return more;
 
 }
 
 
-// go through both vectors, avl and linear until whereColumn and whereData is found, output not found otherwise
-// then print specified selectColumn information related to whereColumn and whereData
-void selectSpecific(string tablename, int offset, int numColumns, vector<string> tokens, vector<string> columnVector, 
-			vector<string> indexVector, vector<avltree<string, streamoff>> avlVector, vector<string> linearVector) {
+// set by SIGINT and SIGTERM, which also write a byte to StopWake (the
+// server's wake pipe) so its poll loop sees it
+static volatile sig_atomic_t StopRequested = 0;
+static int StopWake = -1;
+
+static void requestStop(int) {
 
-	bool found = false;
-	string selectColumn = tokens[1];
-	string whereColumn = tokens[5];
-	string whereData = tokens[7];
+	int saved = errno;
+	StopRequested = 1;
+	write(StopWake, "s", 1);
+	errno = saved;
 
-	// check if column is indexed
-	for (unsigned i = 0; i < indexVector.size(); i++) {
+}
 
-		if (whereColumn == indexVector[i]) { // indexed column
 
-			streamoff *dataPos = avlVector[i].search(whereData);
-			if (dataPos == nullptr) { // whereData does not exist
-				break;
+// serves queries on the table to local clients over a Unix domain socket
+// at socketPath, until SIGINT or SIGTERM.  Then it stops accepting and
+// reading, lets the queries already handed to workers finish, closes
+// every connection and removes the socket, so the caller can close the
+// table as usual.  One thread polls every connection and
+// reads what arrives; once a client has sent complete lines, they are
+// handed to one of numThreads workers, which runs them and sends the
+// results.  So a worker is only held while queries run, and any number
+// of clients can stay connected, idle or not.  A client's next lines
+// wait until its last ones are answered, and a client that pipelines
+// queries gets the results of all that arrived together in one write.
+// If accept fails for want of descriptors or memory, new connections
+// wait 100ms rather than the loop spinning on them.
+// Queries share the indexes under the table's shared lock, and writes
+// take it exclusively (see dbtable).
+void runServer(dbtable& table, const string& socketPath, int numThreads) {
+
+	sockaddr_un address = {};
+	address.sun_family = AF_UNIX;
+	if (socketPath.size() >= sizeof(address.sun_path)) {
+		cout << "**Error: socket path '" << socketPath << "' is too long." << endl;
+		return;
+	}
+	socketPath.copy(address.sun_path, socketPath.size());
+
+	int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	unlink(socketPath.c_str()); // left behind by an earlier server
+	if (listener < 0 || bind(listener, (sockaddr*) &address, sizeof(address)) != 0 || listen(listener, 128) != 0) {
+		cout << "**Error: couldn't listen on socket '" << socketPath << "'." << endl;
+		if (listener >= 0) {
+			close(listener);
+		}
+		return;
+	}
+	int wake[2]; // a worker writes a byte to wake[1] when it finishes a client's lines
+	if (pipe2(wake, O_NONBLOCK | O_CLOEXEC) != 0) {
+		cout << "**Error: couldn't create the server's wake pipe." << endl;
+		close(listener);
+		return;
+	}
+	signal(SIGPIPE, SIG_IGN); // a client hanging up mid-write is only that client's problem
+	StopWake = wake[1];
+	struct sigaction stop = {};
+	stop.sa_handler = requestStop;
+	sigemptyset(&stop.sa_mask);
+	sigaction(SIGINT, &stop, nullptr);
+	sigaction(SIGTERM, &stop, nullptr);
+
+	map<int, unique_ptr<connection>> clients;  // by descriptor
+	mutex         finishedLock;
+	vector<int>   finished;  // clients whose worker is done, for the poll loop to take back
+	int           numBusy = 0;
+	workerpool    workers(numThreads);
+
+	// hands the complete lines of a client's Pending to a worker
+	auto dispatch = [&](connection& client) {
+		size_t last = client.Pending.rfind('\n');
+		if (last == string::npos) {
+			return;
+		}
+		string lines = client.Pending.substr(0, last + 1);
+		client.Pending.erase(0, last + 1);
+		client.Busy = true;
+		numBusy++;
+		workers.submit([&, lines, c = &client]() {
+			c->Closing = !serveLines(*c, lines);
+			{
+				lock_guard<mutex> guard(finishedLock);
+				finished.push_back(c->Fd);
 			}
-			found = true;
-			vector<string> dataRecord;
-			dataRecord = GetRecord(tablename, *dataPos, numColumns);
-			
-			// print selected column data
-			for (unsigned j = 0; j < columnVector.size(); j++) {
-				if (selectColumn == columnVector[j]) {
-					cout << columnVector[j]
-					<< ": "
-					<< dataRecord[j]
-					<< endl;
-					break;
+			write(wake[1], "w", 1); // if the pipe is full, the poll loop is awake already
+		});
+	};
+	auto drop = [&](int fd) {
+		close(fd);
+		clients.erase(fd);
+	};
+
+	cout << "Serving " << table.name() << " on " << socketPath
+	<< " with " << numThreads << " threads..." << endl;
+	vector<pollfd> polled;
+	char chunk[65536];
+	bool stopping = false;
+	auto acceptAfter = chrono::steady_clock::now();  // accept paused until then
+	while (!stopping || numBusy > 0) {
+		polled.clear();
+		polled.push_back(pollfd{ wake[0], POLLIN, 0 });
+		int timeout = -1;
+		size_t firstClient = 1;
+		if (!stopping) {
+			auto now = chrono::steady_clock::now();
+			if (now >= acceptAfter) {
+				polled.push_back(pollfd{ listener, POLLIN, 0 });
+				firstClient = 2;
+			}
+			else {
+				timeout = chrono::duration_cast<chrono::milliseconds>(acceptAfter - now).count() + 1;
+			}
+			for (auto& entry : clients) {
+				if (!entry.second->Busy) { // a busy client's next lines wait in the socket
+					polled.push_back(pollfd{ entry.first, POLLIN, 0 });
 				}
 			}
-
+		}
+		if (poll(polled.data(), polled.size(), timeout) < 0) {
+			if (errno != EINTR) {
+				cout << "**Error: couldn't poll the server's connections." << endl;
+				stopping = true;
+			}
+			continue;
+		}
+		if (StopRequested && !stopping) {
+			stopping = true;
+			cout << "Stopping..." << endl;
 		}
 
-	}
-	if (found == false) {
-
-		// check if column is not-indexed
-		for (unsigned i = 0; i < linearVector.size(); i++) {
-
-			if (whereColumn == linearVector[i]) {
+		if (polled[0].revents != 0) { // workers finished: their clients are the loop's again
+			while (read(wake[0], chunk, sizeof(chunk)) > 0) {
+			}
+			vector<int> done;
+			{
+				lock_guard<mutex> guard(finishedLock);
+				done.swap(finished);
+			}
+			for (int fd : done) {
+				connection& client = *clients[fd];
+				client.Busy = false;
+				numBusy--;
+				if (client.Closing) {
+					drop(fd);
+				}
+				else if (!stopping) {
+					dispatch(client); // lines that arrived with the last ones
+				}
+			}
+		}
 
-				int matchColumn = 0;
-				// find the matchColumn integer for LinearSearch function
-				for (unsigned j = 0; j < columnVector.size(); j++) {
-					if (whereColumn == columnVector[j]) {
-						matchColumn = j + 1;
-						break;
-					}
+		if (stopping) {
+			continue;
+		}
+		if (firstClient == 2 && polled[1].revents != 0) {
+			while (true) {
+				int fd = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+				if (fd >= 0) {
+					clients[fd] = make_unique<connection>(table, fd);
+					clients[fd]->DataRecord.reserve(table.numColumns());
 				}
-				vector<streamoff> dataPosVector = LinearSearch(tablename, offset, numColumns, whereData, matchColumn);
-				if (dataPosVector.empty()) { // whereData does not exist
+				else if (errno != EINTR && errno != ECONNABORTED) {
+					if (errno != EAGAIN && errno != EWOULDBLOCK) { // e.g. EMFILE: try again later
+						acceptAfter = chrono::steady_clock::now() + chrono::milliseconds(100);
+					}
 					break;
 				}
-				found = true;
-				vector<string> dataRecord;
-
-				// loop through all position of records given by linear search
-				// then, create a record vector for each line found
-				// finally, print the all data for each record line
-				for (unsigned k = 0; k < dataPosVector.size(); k++) {
-
-					dataRecord = GetRecord(tablename, dataPosVector[k], numColumns);
-					for (unsigned j = 0; j < columnVector.size(); j++) {
-						if (selectColumn == columnVector[j]) {
-							cout << columnVector[j]
-							<< ": "
-							<< dataRecord[j]
-							<< endl;
-							break;
-						}
-					}
-
-				}						
-
 			}
-
 		}
 
+		for (size_t i = firstClient; i < polled.size(); i++) {
+			if (polled[i].revents == 0) {
+				continue;
+			}
+			int fd = polled[i].fd;
+			connection& client = *clients[fd];
+			ssize_t received = read(fd, chunk, sizeof(chunk));
+			if (received <= 0) { // hung up
+				drop(fd);
+				continue;
+			}
+			client.Pending.append(chunk, received);
+			size_t last = client.Pending.rfind('\n');
+			size_t partial = client.Pending.size() - (last == string::npos ? 0 : last + 1);
+			if (partial > MaxQueryLength) {
+				string error = "Query too long, disconnected...\n\n";
+				write(fd, error.data(), error.size());
+				drop(fd);
+				continue;
+			}
+			dispatch(client);
+		}
 	}
-	if (found == false) { // not found in both vectors
-		cout << "Not found..."
-		<< endl;
+
+	// no worker is running a task now; the pool's threads are joined as
+	// it goes out of scope, after the connections are closed
+	for (auto& entry : clients) {
+		close(entry.first);
 	}
+	clients.clear();
+	close(listener);
+	unlink(socketPath.c_str());
+	signal(SIGINT, SIG_DFL);
+	signal(SIGTERM, SIG_DFL);
+	StopWake = -1;
+	close(wake[0]);
+	close(wake[1]);
+	cout << "Server stopped." << endl;
 
 }
 
 
-int main() {
+// usage: program.exe [--threads N] [--btree-cache N] [--record-cache N] [--stats]
+//                    [--no-sync] [--batch file | --serve socket [--server-threads N]]
+// --threads sets how many threads scan an unindexed column (default:
+// one per core, 1 to scan serially)
+// --btree-cache sets how many 4KB pages of each B+tree index are kept
+// in memory (default 1024)
+// --record-cache sets how many parsed records are cached for repeated
+// lookups (default 4096, 0 for none; with --serve, default 0, since
+// every lookup of the cache takes its one lock)
+// --stats collects query stats from the start (see the stats command)
+// --no-sync doesn't wait for each insert, update or delete to reach the
+// disk; faster, but a crash may lose the last writes
+// --batch reads the tablename and then one query per line from file
+// (- for stdin), without prompts, and prints a throughput summary
+// --serve reads the tablename from stdin, builds the indexes once, and
+// then serves queries from many clients at once over a Unix domain socket
+// (see loadgen.cpp); --server-threads sets how many clients' queries
+// run at a time (default: one per core)
+int main(int argc, char* argv[]) {
+
+	int scanThreads = thread::hardware_concurrency();
+	size_t btreeCache = 1024;
+	long recordCache = -1; // -1: the default, which depends on the mode
+	string batchFile; // empty: interactive
+	bool syncWrites = true;
+	string serveSocket; // empty: not a server
+	int serverThreads = thread::hardware_concurrency();
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		if (arg == "--threads" && i + 1 < argc) {
+			scanThreads = atoi(argv[++i]);
+		}
+		else if (arg == "--btree-cache" && i + 1 < argc) {
+			btreeCache = atoi(argv[++i]);
+		}
+		else if (arg == "--record-cache" && i + 1 < argc) {
+			recordCache = max(0, atoi(argv[++i]));
+		}
+		else if (arg == "--stats") {
+			StatsOn = true;
+		}
+		else if (arg == "--no-sync") {
+			syncWrites = false;
+		}
+		else if (arg == "--batch" && i + 1 < argc) {
+			batchFile = argv[++i];
+		}
+		else if (arg == "--serve" && i + 1 < argc) {
+			serveSocket = argv[++i];
+		}
+		else if (arg == "--server-threads" && i + 1 < argc) {
+			serverThreads = atoi(argv[++i]);
+		}
+	}
+
+	// in batch mode queries come from the file instead of the keyboard
+	ifstream batchStream;
+	if (batchFile != "" && batchFile != "-") {
+		batchStream.open(batchFile);
+		if (!batchStream.good()) {
+			cout << "**Error: couldn't open batch file '" << batchFile << "'." << endl;
+			return 0;
+		}
+	}
+	istream& in = batchStream.is_open() ? batchStream : cin;
+	bool batch = (batchFile != "");
 
 	string tablename; // = "students";
-	cout << "Welcome to myDB, please enter tablename> ";
-	getline(cin, tablename);
+	if (!batch && serveSocket == "") {
+		cout << "Welcome to myDB, please enter tablename> ";
+	}
+	getline(in, tablename);
 	cout << "Reading meta-data..." << endl;
 
-	// create vector with .meta data
-	vector<string> metaVector = createMetaVector(tablename);
-	int offset = stoi(metaVector[0]); // hold offset from .meta
-	int numColumns = stoi(metaVector[1]); // hold number of columns from .meta
-	cout << "Building index tree(s)..." << endl;
-
-	// declare vectors for organization of necessary information..
-	vector<string> columnVector; // holds all columns
-	vector<string> linearVector; // holds non-indexed columns
-	vector<string> indexVector; // holds indexed columns
-	vector<avltree<string, streamoff>> avlVector; // holds avl trees for indexed columns
-
-	int indexVal = 0; // which column is index
-	// loop though meta data and if column is followed by 1, then it is indexed
-	// if, column is followed by 0, then it is not-indexed
-	for (unsigned i = 2; i < metaVector.size(); i = i + 2) {
-
-		string key = metaVector[i]; // hold column
-		string isIndex = metaVector[i+1]; // hold 0 or 1
-		columnVector.push_back(key); // create column only vector
-
-		// if indexed, then create new tree and populate
-		// then, append to vectors to map column vector to corresponding tree in avl vector
-		if ( isIndex == "1" ) {
-			avltree<string, streamoff> newAvlTree;
-			populateAvlTree(tablename, offset, numColumns, indexVal, newAvlTree);
-			indexVector.push_back(key);
-			avlVector.push_back(newAvlTree);
-		}
-		else if (isIndex == "0") { // if not-indexed, append column to linearsearch vector
-			linearVector.push_back(key);
-		}
-		indexVal++;
-
+	// read .meta and map .data
+	dbtable table;
+	if (!table.open(tablename)) {
+		return 0;
+	}
+	table.setScanThreads(scanThreads);
+	table.setBtreeCache(btreeCache);
+	if (recordCache < 0) {
+		recordCache = (serveSocket != "") ? 0 : 4096;
+	}
+	table.setRecordCache(recordCache);
+	table.setSyncWrites(syncWrites);
+	cout << "Building index tree(s)..." << flush;
+	auto buildStart = chrono::steady_clock::now();
+	int indexesLoaded = table.buildIndexes();
+
+	// finish the banner line with the cold-start time
+	chrono::duration<double, milli> buildTime = chrono::steady_clock::now() - buildStart;
+	cout << " " << buildTime.count() << " ms ("
+	<< indexesLoaded << " loaded, "
+	<< table.indexVector().size() - indexesLoaded << " rebuilt)"
+	<< endl;
+
+	printAvlInfo(table); // print avl tree info
+
+	vector<string_view> dataRecord; // reused by every query, so lookups don't allocate
+	dataRecord.reserve(table.numColumns());
+
+	if (serveSocket != "") {
+		runServer(table, serveSocket, max(1, serverThreads));
+		printCacheInfo(table);
+		return 0;
 	}
 
-	printAvlInfo(indexVector, avlVector); // print avl tree info
+	plancache plans(table); // parsed queries, by shape
+
+	if (batch) {
+		cout << endl;
+		runBatch(plans, in, dataRecord);
+		printCacheInfo(table);
+		return 0;
+	}
 	
 	// main loop to input and execute queries from the user:
 	string query;
 	cout << endl;
 	cout << "Enter query> ";
-	getline(cin, query);
-	while (query != "exit") {
-
-		vector<string> tokens = tokenize(query); // hold user input
-		
-		// error checking...
-		bool valid = errorCheck(tablename, tokens, columnVector);
-		
-		// no error found
-		if (valid == true) {
-
-			if ( tokens[1] == "*" ) { // select item is *, so select all
-				selectAll(tablename, offset, numColumns, tokens, columnVector, indexVector, avlVector, linearVector);
-			}
-			else { // select item is a specific column
-				selectSpecific(tablename, offset, numColumns, tokens, columnVector, indexVector, avlVector, linearVector);
-			}
+	while (getline(cin, query) && query != "exit") {
 
-		}
-
-		cout << endl;
-		cout << "Enter query> ";
-		getline(cin, query);
+		runQuery(plans, query, dataRecord, cout);
+		cout << "Enter query> " << flush;
 
 	}
+	printCacheInfo(table);
 	return 0;
 
-}
\ No newline at end of file
+}
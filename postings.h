@@ -0,0 +1,162 @@
+#ifndef POSTINGS_H
+#define POSTINGS_H
+
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+#include <utility>  // std::swap
+using namespace std;
+
+
+// The file positions of every record that has a given key, in file
+// order.  Used as the value type of an index so a non-unique column
+// keeps all its rows.  The common case of a single position is stored
+// inline; only keys with duplicates allocate an array.  Iterate with
+// begin()/end() like any other range.
+class postinglist {
+
+private:
+
+	union {
+		streamoff  One;   // the position, when Count <= 1
+		streamoff* Many;  // heap array of Capacity positions, when Count > 1
+	};
+	uint32_t Count;     // # of positions
+	uint32_t Capacity;  // size of Many (0 while inline)
+
+public:
+
+	postinglist() {
+
+		One = 0;
+		Count = 0;
+		Capacity = 0;
+
+	}
+
+
+	explicit postinglist(streamoff pos) : postinglist() {	push_back(pos);	}
+
+
+	postinglist(const postinglist& other) : postinglist() {
+
+		if (other.Count > 1) {
+			Many = new streamoff[other.Count];
+			memcpy(Many, other.Many, other.Count * sizeof(streamoff));
+			Capacity = other.Count;
+		}
+		else {
+			One = other.One;
+		}
+		Count = other.Count;
+
+	}
+
+
+	postinglist(postinglist&& other) noexcept : postinglist() {	swap(other);	}
+
+
+	postinglist& operator=(postinglist other) noexcept {
+
+		swap(other);
+		return *this;
+
+	}
+
+
+	~postinglist() {
+
+		if (Capacity > 0) {
+			delete[] Many;
+		}
+
+	}
+
+
+	void swap(postinglist& other) noexcept {
+
+		std::swap(One, other.One);  // the whole union
+		std::swap(Count, other.Count);
+		std::swap(Capacity, other.Capacity);
+
+	}
+
+
+	// appends a position; moves to the heap on the second position and
+	// doubles the array when it fills up.
+	void push_back(streamoff pos) {
+
+		if (Count == 0) {
+			One = pos;
+		}
+		else if (Count == 1 && Capacity == 0) {
+			streamoff first = One;
+			Many = new streamoff[4];
+			Capacity = 4;
+			Many[0] = first;
+			Many[1] = pos;
+		}
+		else {
+			if (Count == Capacity) {
+				streamoff* bigger = new streamoff[Capacity * 2];
+				memcpy(bigger, Many, Count * sizeof(streamoff));
+				delete[] Many;
+				Many = bigger;
+				Capacity *= 2;
+			}
+			Many[Count] = pos;
+		}
+		Count++;
+
+	}
+
+
+	// removes pos, keeping the rest in file order.  Returns false if
+	// pos isn't in the list.
+	bool erase(streamoff pos) {
+
+		streamoff* first = begin();
+		streamoff* last = end();
+		streamoff* found = first;
+		while (found != last && *found != pos) {
+			found++;
+		}
+		if (found == last) {
+			return false;
+		}
+		memmove(found, found + 1, (last - found - 1) * sizeof(streamoff));
+		Count--;
+		if (Count == 1 && Capacity > 0) { // back to inline
+			streamoff only = Many[0];
+			delete[] Many;
+			Capacity = 0;
+			One = only;
+		}
+		return true;
+
+	}
+
+
+	size_t size() const   {	return Count;	}
+	bool   empty() const  {	return Count == 0;	}
+
+	const streamoff* begin() const  {	return (Capacity > 0) ? Many : &One;	}
+	const streamoff* end() const    {	return begin() + Count;	}
+	streamoff* begin()  {	return (Capacity > 0) ? Many : &One;	}
+	streamoff* end()    {	return begin() + Count;	}
+	streamoff operator[](size_t i) const  {	return begin()[i];	}
+
+};
+
+
+// lets avltree::inorder print an index's values.
+inline ostream& operator<<(ostream& out, const postinglist& postings) {
+
+	for (size_t i = 0; i < postings.size(); i++) {
+		out << (i == 0 ? "" : " ") << postings[i];
+	}
+	return out;
+
+}
+
+#endif
@@ -0,0 +1,1084 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <algorithm>
+#include <iterator>
+#include "query.h"
+#include "aggregate.h"
+using namespace std;
+
+
+// breaks line into tokens at each space, as views into line.  Matches
+// getline(stream, token, ' '): "a  b" has an empty token between a and b,
+// and a trailing space doesn't start another token.
+static void splitTokens(string_view line, vector<string_view>& tokens) {
+
+	tokens.clear();
+	size_t start = 0;
+	while (start < line.size()) {
+		size_t space = line.find(' ', start);
+		if (space == string_view::npos) {
+			space = line.size();
+		}
+		tokens.push_back(line.substr(start, space - start));
+		start = space + 1;
+	}
+
+}
+
+
+// ordinal of the column called name, -1 if there is none
+static int findColumn(const dbtable& table, string_view name) {
+
+	const vector<string>& columnVector = table.columnVector();
+	for (unsigned i = 0; i < columnVector.size(); i++) {
+		if (name == columnVector[i]) {
+			return i;
+		}
+	}
+	return -1;
+
+}
+
+
+// the access path of a where clause term on column: the column's index
+// if it has one that can answer the term, else a scan if the column is
+// searchable at all.  A number column's index is in numeric order, so
+// like, which matches text, scans.
+static int choosePath(const dbtable& table, int column, const predicate& where, int& index) {
+
+	index = table.columnIndex(column);
+	if (index >= 0) {
+		const string& kind = table.indexKind(index);
+		if (where.Op == "like" && where.Type != columnfile::String) {
+			return query::Scan;
+		}
+		else if (kind == "hash") {
+			return (where.Op == "=") ? query::HashIndex : query::Scan;
+		}
+		else if (kind == "btree") {
+			return query::BtreeIndex;
+		}
+		return query::FlatIndex;
+	}
+	const vector<string>& linearVector = table.linearVector();
+	for (unsigned i = 0; i < linearVector.size(); i++) {
+		if (table.columnVector()[column] == linearVector[i]) {
+			return query::Scan;
+		}
+	}
+	return query::NoPath;
+
+}
+
+
+// checks the where clause of a query, tokens[w, end): "where term",
+// or several terms joined by and or or, where a term is "col op value"
+// or "col between value and value".  Fills in q's where column,
+// predicate and access path from it, or with several terms, q's Terms.
+// invalid is the error for tokens that aren't a where clause.
+static void parseWhere(const dbtable& table, const vector<string_view>& tokens, size_t w, size_t end,
+			const char* invalid, query& q) {
+
+	if (end < w + 4 || tokens[w] != "where") {
+		q.Error = invalid;
+		return;
+	}
+	vector<term> terms;
+	size_t i = w + 1; // the term's column
+	while (true) {
+		term t;
+		t.Or = !terms.empty() && tokens[i - 1] == "or";
+		if (end < i + 3) {
+			q.Error = invalid;
+			return;
+		}
+		t.Column = findColumn(table, tokens[i]);
+		if (t.Column < 0) {
+			q.Error = "Invalid where column, ignored...";
+			return;
+		}
+		string_view op = tokens[i + 1];
+		bool between = (op == "between" && end >= i + 5 && tokens[i + 3] == "and");
+		bool compare = (op == "=" || op == "<" || op == "<=" || op == ">" || op == ">=" || op == "like");
+		if (!between && !compare) {
+			q.Error = invalid;
+			return;
+		}
+		t.Where.Op = string(op);
+		t.Where.Value = string(tokens[i + 2]);
+		t.Where.Value2 = between ? string(tokens[i + 4]) : "";
+		t.Where.prepare(table.columnTypes()[t.Column]);
+		t.Path = choosePath(table, t.Column, t.Where, t.Index);
+		terms.push_back(t);
+
+		size_t next = i + (between ? 5 : 3);
+		if (next == end) {
+			break;
+		}
+		if (next + 1 >= end || (tokens[next] != "and" && tokens[next] != "or")) {
+			q.Error = invalid;
+			return;
+		}
+		i = next + 1;
+	}
+
+	q.Valid = true;
+	q.WhereColumn = terms[0].Column;
+	if (terms.size() == 1) {
+		q.Where = terms[0].Where;
+		q.Path = terms[0].Path;
+		q.Index = terms[0].Index;
+	}
+	else {
+		q.Terms = terms;
+		q.Path = query::Combined;
+	}
+
+}
+
+
+// positions in tokens of the values of the where clause at tokens[w]:
+// the token after each term's operator, and after between, the token
+// after its and too.  Parsing reads none of them, so queries that differ
+// only in these share a plan.
+static void whereValues(const vector<string_view>& tokens, size_t w, vector<size_t>& positions) {
+
+	positions.clear();
+	if (tokens.size() <= w || tokens[w] != "where") {
+		return;
+	}
+	size_t i = w + 1; // a term's column
+	while (i + 2 < tokens.size()) {
+		positions.push_back(i + 2);
+		size_t next = i + 3;
+		if (tokens[i + 1] == "between" && i + 4 < tokens.size()) {
+			positions.push_back(i + 4);
+			next = i + 5;
+		}
+		if (next >= tokens.size() || (tokens[next] != "and" && tokens[next] != "or")) {
+			break;
+		}
+		i = next + 1;
+	}
+
+}
+
+
+// the checks of parseTokens for insert, update and delete queries
+// true if value can be stored in column: one word, and a number if
+// .meta types the column int or double, so every index and aggregate
+// of the column can read it
+static bool validValue(const dbtable& table, int column, string_view value) {
+
+	if (value.empty() || value.find_first_of(" \t\r\n") != string_view::npos) {
+		return false;
+	}
+	int type = table.columnTypes()[column];
+	if (type == columnfile::Int) {
+		int64_t number;
+		return ParseKey(value, number);
+	}
+	if (type == columnfile::Double) {
+		double number;
+		return ParseKey(value, number);
+	}
+	return true;
+
+}
+
+
+static void parseWrite(const dbtable& table, const vector<string_view>& tokens, query& q) {
+
+	if (tokens[0] == "insert") {
+		q.Kind = query::Insert;
+		if (tokens.size() < 4 || tokens[1] != "into") {
+			q.Error = "Invalid insert query, ignored...";
+			return;
+		}
+		if (tokens[2] != table.name()) {
+			q.Error = "Invalid table name, ignored...";
+			return;
+		}
+		if (tokens[3] != "values" || tokens.size() != 4 + (size_t) table.numColumns()) {
+			q.Error = "Invalid insert query, ignored...";
+			return;
+		}
+		for (size_t i = 4; i < tokens.size(); i++) {
+			if (tokens[i].empty()) {
+				q.Error = "Invalid insert query, ignored...";
+				return;
+			}
+			if (!validValue(table, i - 4, tokens[i])) {
+				q.Error = "Invalid " + table.columnVector()[i - 4] + " value, ignored...";
+				return;
+			}
+			q.Values.push_back(string(tokens[i]));
+		}
+		q.Valid = true;
+	}
+	else if (tokens[0] == "update") {
+		q.Kind = query::Update;
+		if (tokens.size() < 7) {
+			q.Error = "Invalid update query, ignored...";
+			return;
+		}
+		if (tokens[1] != table.name()) {
+			q.Error = "Invalid table name, ignored...";
+			return;
+		}
+		if (tokens[2] != "set" || tokens[4] != "=" || tokens[5].empty()) {
+			q.Error = "Invalid update query, ignored...";
+			return;
+		}
+		q.SetColumn = findColumn(table, tokens[3]);
+		if (q.SetColumn < 0) {
+			q.Error = "Invalid set column, ignored...";
+			return;
+		}
+		if (!validValue(table, q.SetColumn, tokens[5])) {
+			q.Error = "Invalid " + table.columnVector()[q.SetColumn] + " value, ignored...";
+			return;
+		}
+		q.Values.push_back(string(tokens[5]));
+		parseWhere(table, tokens, 6, tokens.size(), "Invalid update query, ignored...", q);
+	}
+	else {
+		q.Kind = query::Delete;
+		if (tokens.size() < 3 || tokens[1] != "from") {
+			q.Error = "Invalid delete query, ignored...";
+			return;
+		}
+		if (tokens[2] != table.name()) {
+			q.Error = "Invalid table name, ignored...";
+			return;
+		}
+		parseWhere(table, tokens, 3, tokens.size(), "Invalid delete query, ignored...", q);
+	}
+
+}
+
+
+// parses a list of aggregates, "count(*),avg(latitude)", into q;
+// false if one isn't an aggregate of a column of the table
+static bool parseAggregates(const dbtable& table, string_view list, query& q) {
+
+	static const char* names[] = { "count", "sum", "avg", "min", "max" };
+	size_t start = 0;
+	while (start <= list.size()) {
+		size_t comma = list.find(',', start);
+		if (comma == string_view::npos) {
+			comma = list.size();
+		}
+		string_view text = list.substr(start, comma - start);
+		start = comma + 1;
+
+		size_t open = text.find('(');
+		if (open == string_view::npos || text.back() != ')') {
+			return false;
+		}
+		string_view name = text.substr(0, open), arg = text.substr(open + 1, text.size() - open - 2);
+		aggregate agg;
+		agg.Function = -1;
+		for (int i = aggregate::Count; i <= aggregate::Max; i++) {
+			if (name == names[i]) {
+				agg.Function = i;
+			}
+		}
+		agg.Column = (arg == "*") ? -1 : findColumn(table, arg);
+		agg.Name = string(text);
+		if (agg.Function < 0 || (agg.Function == aggregate::Count) != (arg == "*") ||
+				(agg.Function != aggregate::Count && agg.Column < 0)) {
+			return false;
+		}
+		if ((agg.Function == aggregate::Sum || agg.Function == aggregate::Avg) &&
+				table.columnTypes()[agg.Column] == columnfile::String) { // only numbers add up
+			return false;
+		}
+		q.Aggregates.push_back(agg);
+	}
+	return true;
+
+}
+
+
+// the checks of parseTokens for aggregate queries:
+// "select agg,agg,... from table [where ...] [group by col]"
+static void parseAggregate(const dbtable& table, const vector<string_view>& tokens, query& q) {
+
+	if (!parseAggregates(table, tokens[1], q)) {
+		q.Error = "Invalid aggregate, ignored...";
+		return;
+	}
+	if (tokens.size() < 4 || tokens[2] != "from") {
+		q.Error = "Invalid select query, ignored...";
+		return;
+	}
+	if (tokens[3] != table.name()) {
+		q.Error = "Invalid table name, ignored...";
+		return;
+	}
+	size_t end = tokens.size();
+	if (end >= 7 && tokens[end - 3] == "group" && tokens[end - 2] == "by") {
+		q.GroupColumn = findColumn(table, tokens[end - 1]);
+		if (q.GroupColumn < 0) {
+			q.Error = "Invalid group by column, ignored...";
+			return;
+		}
+		end -= 3;
+	}
+	if (end == 4) { // no where clause, every record
+		q.Valid = true;
+		return;
+	}
+	parseWhere(table, tokens, 4, end, "Invalid select query, ignored...", q);
+
+}
+
+
+// true if tokens are an insert, update or delete query
+static bool isWrite(const vector<string_view>& tokens) {
+
+	return !tokens.empty() && (tokens[0] == "insert" || tokens[0] == "update" || tokens[0] == "delete");
+
+}
+
+
+// checks the tokens of a query, and fills in q from them.  Same checks
+// and messages as the old errorCheck, in the same order.
+static void parseTokens(const dbtable& table, const vector<string_view>& tokens, query& q) {
+
+	q.Valid = false;
+	q.Error.clear();
+	q.Kind = query::Select;
+	q.SelectColumn = -1;
+	q.Aggregates.clear();
+	q.GroupColumn = -1;
+	q.SetColumn = -1;
+	q.Values.clear();
+	q.WhereColumn = -1;
+	q.Path = query::NoPath;
+	q.Index = -1;
+	q.Where = predicate();
+	q.Terms.clear();
+
+	if (isWrite(tokens)) {
+		parseWrite(table, tokens, q);
+		return;
+	}
+	if (tokens.empty() || (tokens[0] != "select" && tokens[0] != "exit")) {
+		q.Error = "Unknown query, ignored...";
+		return;
+	}
+	if (tokens.size() > 1 && tokens[0] == "select" && tokens[1].find('(') != string_view::npos) {
+		parseAggregate(table, tokens, q);
+		return;
+	}
+	if (tokens.size() > 1 && tokens[1] != "*") {
+		q.SelectColumn = findColumn(table, tokens[1]);
+		if (q.SelectColumn < 0) {
+			q.Error = "Invalid select column, ignored...";
+			return;
+		}
+	}
+	if (tokens.size() < 8 || tokens[2] != "from") {
+		q.Error = "Invalid select query, ignored...";
+		return;
+	}
+	if (tokens[3] != table.name()) {
+		q.Error = "Invalid table name, ignored...";
+		return;
+	}
+	parseWhere(table, tokens, 4, tokens.size(), "Invalid select query, ignored...", q);
+
+}
+
+
+void ParseQuery(const dbtable& table, string_view text, query& q) {
+
+	vector<string_view> tokens;
+	splitTokens(text, tokens);
+	parseTokens(table, tokens, q);
+
+}
+
+
+// scans for the records whose column (0-based) satisfies the where
+// clause: in the typed .col file if the table has one, which reads only
+// that column, else in the .data file
+static vector<streamoff> scanColumn(const dbtable& table, const predicate& where, int column) {
+
+	vector<streamoff> dataPosVector;
+	if (table.columns().isOpen() &&
+			ColumnSearch(table.columns(), where, column, table.recordSize(), dataPosVector)) {
+		if (table.numDeleted() > 0) { // the .col file still has the deleted records
+			const datafile& data = table.data();
+			dataPosVector.erase(remove_if(dataPosVector.begin(), dataPosVector.end(),
+				[&](streamoff pos) {	return data.deleted(pos);	}), dataPosVector.end());
+		}
+		return dataPosVector;
+	}
+	return LinearSearch(table.data(), where, column + 1, table.scanPool());
+
+}
+
+
+// the records matching a where clause on column along path, with the
+// table's index # index.  An index whose flatindex or hash table
+// snapshot is stale is searched in its avl tree instead, which writes
+// keep up to date.
+static vector<streamoff> findTerm(const dbtable& table, const predicate& where, int column, int path, int index) {
+
+	if (!where.Valid) { // a value that isn't of the column's type
+		return vector<streamoff>();
+	}
+	else if ((path == query::FlatIndex || path == query::HashIndex) && table.indexStale(index)) {
+		return IndexSearch(table.avlVector()[index], where);
+	}
+	else if (path == query::HashIndex) {
+		positionrange postings = table.hashVector()[index].find(where.Key);
+		return vector<streamoff>(postings.begin(), postings.end());
+	}
+	else if (path == query::FlatIndex) { // walk the index over the matching range of keys
+		return IndexSearch(table.flatVector()[index], where);
+	}
+	else if (path == query::BtreeIndex) { // B+tree, read from its pages
+		return IndexSearch(table.btreeIndex(index), where);
+	}
+	else if (path == query::Scan) { // no index can answer it, scan the column
+		return scanColumn(table, where, column);
+	}
+	return vector<streamoff>();
+
+}
+
+
+// the fraction of a column's values a where clause is guessed to match,
+// when there is no index to count them
+static double guessSelectivity(const predicate& where) {
+
+	if (where.Op == "=" || where.Op == "like") {
+		return 0.1;
+	}
+	else if (where.Op == "between") {
+		return 0.25;
+	}
+	return 0.33;
+
+}
+
+
+// # of levels of a balanced binary search over size keys
+static int64_t searchDepth(size_t size) {
+
+	int64_t depth = 0;
+	while (size > 0) {
+		size >>= 1;
+		depth++;
+	}
+	return depth;
+
+}
+
+
+// An index whose term finds more than this many times the records the
+// most selective index of its and-group finds is cheaper to test on
+// each candidate record than to read and intersect.
+static const int64_t IntersectRatio = 8;
+
+
+// how one and-group of a where clause of several terms is answered
+struct groupplan {
+
+	vector<const term*> Indexed;    // terms whose index positions are intersected, most selective first
+	vector<int64_t>     Estimates;  // # of records each of them finds
+	vector<const term*> Residual;   // terms tested on each candidate record
+	int  ColumnTerm;  // no index: the term of Residual the .col file scans for candidates, -1 for a .data scan
+	bool Empty;       // a term matches nothing, so the group does too
+
+};
+
+
+static bool isIndexPath(int path) {
+
+	return path == query::FlatIndex || path == query::HashIndex || path == query::BtreeIndex;
+
+}
+
+
+// # of records a term's index finds: counted from a frozen index or
+// hash table, which tell without reading any positions, else guessed
+static int64_t estimateMatches(const dbtable& table, const term& t) {
+
+	bool stale = (t.Path == query::FlatIndex || t.Path == query::HashIndex) && table.indexStale(t.Index);
+	if (t.Path == query::FlatIndex && !stale) {
+		const flatindex& index = table.flatVector()[t.Index];
+		size_t first, last;
+		IndexRange(index, t.Where, first, last);
+		return index.positions(first, last).size();
+	}
+	else if (t.Path == query::HashIndex && !stale) {
+		return table.hashVector()[t.Index].find(t.Where.Key).size();
+	}
+	int64_t numRecords = (table.recordSize() > 0) ?
+		(table.data().length() + table.recordSize() - 1) / table.recordSize() - table.numDeleted() : 0;
+	return (int64_t) (numRecords * guessSelectivity(t.Where));
+
+}
+
+
+// plans the and-group of terms [first, last): its indexed terms, most
+// selective first, as far as they are worth intersecting, and the rest
+// to test on each record.  A group with no index is scanned: in the .col
+// file if it can scan one of the terms, else in the .data file.
+static groupplan planGroup(const dbtable& table, const term* first, const term* last) {
+
+	groupplan plan;
+	plan.ColumnTerm = -1;
+	plan.Empty = false;
+	vector<pair<int64_t, const term*>> indexed;
+	for (const term* t = first; t != last; t++) {
+		if (!t->Where.Valid || t->Path == query::NoPath) {
+			plan.Empty = true;
+		}
+		else if (isIndexPath(t->Path)) {
+			indexed.push_back(make_pair(estimateMatches(table, *t), t));
+		}
+		else {
+			plan.Residual.push_back(t);
+		}
+	}
+	stable_sort(indexed.begin(), indexed.end(),
+		[](const pair<int64_t, const term*>& a, const pair<int64_t, const term*>& b) {	return a.first < b.first;	});
+	for (size_t k = 0; k < indexed.size(); k++) {
+		if (k == 0 || indexed[k].first <= IntersectRatio * indexed[0].first) {
+			plan.Indexed.push_back(indexed[k].second);
+			plan.Estimates.push_back(indexed[k].first);
+		}
+		else {
+			plan.Residual.push_back(indexed[k].second);
+		}
+	}
+
+	if (plan.Indexed.empty() && table.columns().isOpen()) {
+		for (size_t k = 0; k < plan.Residual.size() && plan.ColumnTerm < 0; k++) {
+			const term* t = plan.Residual[k];
+			if (table.columnTypes()[t->Column] == columnfile::String || t->Where.Op != "like") {
+				plan.ColumnTerm = k;
+			}
+		}
+	}
+	return plan;
+
+}
+
+
+// the fields of one record of the .data file, found as terms ask for
+// them; the last one found is kept, since terms on one column are
+// usually next to each other (between, or an or of values)
+struct recordfields {
+
+	const char* Data;
+	streamoff   Pos;
+	streamoff   End;
+	int         Column;  // of Value, -1 before any is found
+	string_view Value;
+
+	recordfields(const char* data, streamoff pos, streamoff end) {	Data = data; Pos = pos; End = end; Column = -1;	}
+
+	string_view at(int column) {
+		if (column != Column) {
+			Value = FieldAt(Data, Pos, End, column);
+			Column = column;
+		}
+		return Value;
+	}
+
+};
+
+
+// true if the record satisfies every one of terms, skipping terms[skip]
+static bool testTerms(recordfields& record, const vector<const term*>& terms, int skip = -1) {
+
+	for (size_t k = 0; k < terms.size(); k++) {
+		const term* t = terms[k];
+		if ((int) k != skip && !t->Where.matches(record.at(t->Column))) {
+			return false;
+		}
+	}
+	return true;
+
+}
+
+
+// calls fn(first, last) for each and-group [first, last) of terms
+template<typename Fn>
+static void forEachGroup(const vector<term>& terms, Fn fn) {
+
+	size_t first = 0;
+	while (first < terms.size()) {
+		size_t last = first + 1;
+		while (last < terms.size() && !terms[last].Or) {
+			last++;
+		}
+		fn(terms.data() + first, terms.data() + last);
+		first = last;
+	}
+
+}
+
+
+// FindRecords for a where clause of several terms, planned by
+// planGroup.  Positions come back in file order.
+static vector<streamoff> combinedSearch(const dbtable& table, const vector<term>& terms) {
+
+	const datafile& data = table.data();
+	vector<streamoff> matches, found, other, merged;
+	vector<groupplan> scans; // groups left for one scan of the .data file
+
+	forEachGroup(terms, [&](const term* first, const term* last) {
+		groupplan plan = planGroup(table, first, last);
+		if (plan.Empty) {
+			return;
+		}
+		if (plan.Indexed.empty() && plan.ColumnTerm < 0) {
+			scans.push_back(plan);
+			return;
+		}
+
+		int skip = -1;
+		if (plan.Indexed.empty()) { // one column of the .col file
+			const term* t = plan.Residual[plan.ColumnTerm];
+			found = scanColumn(table, t->Where, t->Column);
+			skip = plan.ColumnTerm;
+		}
+		else { // intersect the indexes' positions, sorted
+			const term* t = plan.Indexed[0];
+			found = findTerm(table, t->Where, t->Column, t->Path, t->Index);
+			sort(found.begin(), found.end());
+			for (size_t k = 1; k < plan.Indexed.size() && !found.empty(); k++) {
+				t = plan.Indexed[k];
+				other = findTerm(table, t->Where, t->Column, t->Path, t->Index);
+				sort(other.begin(), other.end());
+				merged.clear();
+				set_intersection(found.begin(), found.end(), other.begin(), other.end(), back_inserter(merged));
+				found.swap(merged);
+			}
+		}
+		if ((int) plan.Residual.size() > (skip < 0 ? 0 : 1)) { // test the rest on each candidate
+			CountStat(&querystats::RecordsScanned, found.size());
+			CountStat(&querystats::BytesRead, found.size() * table.recordSize());
+			found.erase(remove_if(found.begin(), found.end(), [&](streamoff pos) {
+				recordfields record(data.data(), pos, min<streamoff>(pos + table.recordSize(), data.length()));
+				return !testTerms(record, plan.Residual, skip);
+			}), found.end());
+		}
+
+		merged.clear();
+		set_union(matches.begin(), matches.end(), found.begin(), found.end(), back_inserter(merged));
+		matches.swap(merged);
+	});
+
+	if (!scans.empty()) {
+		found = LinearSearch(data, [&](streamoff pos, streamoff end) {
+			recordfields record(data.data(), pos, end);
+			for (const groupplan& plan : scans) {
+				if (testTerms(record, plan.Residual)) {
+					return true;
+				}
+			}
+			return false;
+		}, table.scanPool());
+		merged.clear();
+		set_union(matches.begin(), matches.end(), found.begin(), found.end(), back_inserter(merged));
+		matches.swap(merged);
+	}
+	return matches;
+
+}
+
+
+vector<streamoff> FindRecords(const dbtable& table, const query& q) {
+
+	if (q.Path == query::Combined) {
+		return combinedSearch(table, q.Terms);
+	}
+	return findTerm(table, q.Where, q.WhereColumn, q.Path, q.Index);
+
+}
+
+
+void ExplainQuery(const dbtable& table, const query& q, ostream& out) {
+
+	if (!q.Valid) {
+		out << q.Error
+		<< '\n';
+		return;
+	}
+	if (q.Kind == query::Insert) {
+		out << "Access path: none, appended to " << table.name() << ".data" << '\n';
+		out << "  Index steps: 0" << '\n';
+		out << "  Records scanned: 0 (0 bytes)" << '\n';
+		out << "  Records fetched: 0" << '\n';
+		out << "  Estimated cost: 0" << '\n';
+		return;
+	}
+
+	int64_t numRecords = (table.recordSize() > 0) ?
+		(table.data().length() + table.recordSize() - 1) / table.recordSize() : 0;
+	int64_t steps = 0, scanned = 0, bytes = 0, fetched = 0;
+	const char* source = ""; // where fetched comes from
+	int searches = (q.Where.Op == "between") ? 2 : 1; // index searches for the bounds
+
+	if (!q.Aggregates.empty()) {
+		// what is aggregated, and from where; then, if the records are
+		// read, how the where clause finds them, as for any select
+		int from = AggregateSource(table, q);
+		out << "Aggregates:";
+		for (const aggregate& agg : q.Aggregates) {
+			out << ' ' << agg.Name;
+		}
+		if (q.GroupColumn >= 0) {
+			out << " grouped by " << table.columnVector()[q.GroupColumn];
+		}
+		out << ", from " << (from == AggregateFromCount ? "the record count" : from == AggregateFromIndex ? "the index" :
+			from == AggregateFromColumns ? table.name() + ".col" : table.name() + ".data") << '\n';
+
+		if (from == AggregateFromCount) {
+			out << "Access path: none, counted from " << table.name() << ".data's length" << '\n';
+		}
+		else if (from == AggregateFromIndex) {
+			int column = max(q.WhereColumn, q.GroupColumn); // the one column read
+			for (const aggregate& agg : q.Aggregates) {
+				column = max(column, agg.Column);
+			}
+			const flatindex& flat = table.flatVector()[table.columnIndex(column)];
+			size_t first = 0, last = flat.size();
+			if (q.WhereColumn >= 0) {
+				IndexRange(flat, q.Where, first, last);
+				steps = searches * searchDepth(flat.size());
+			}
+			out << "Access path: avl index on " << table.columnVector()[column]
+			<< ", index only (" << flat.size() << " keys)" << '\n';
+			steps += last - first; // every key in the range is read
+		}
+		else if (q.WhereColumn < 0) {
+			out << "Access path: scan of every record in " << table.name()
+			<< (from == AggregateFromColumns ? ".col" : ".data") << '\n';
+			scanned = numRecords;
+			bytes = (from == AggregateFromColumns) ? numRecords * 8 * (int64_t) q.Aggregates.size() : table.data().length();
+		}
+		if (from == AggregateFromCount || from == AggregateFromIndex || q.WhereColumn < 0) {
+			out << "  Index steps: " << steps << '\n';
+			out << "  Records scanned: " << scanned << " (" << bytes << " bytes)" << '\n';
+			out << "  Records fetched: 0" << '\n';
+			out << "  Estimated cost: " << steps + scanned << '\n';
+			return;
+		}
+	}
+
+	const string& column = table.columnVector()[q.WhereColumn];
+
+	if (q.Path == query::FlatIndex || q.Path == query::HashIndex) {
+		// a stale snapshot is searched in its avl tree instead
+		size_t keys = table.indexStale(q.Index) ? table.avlVector()[q.Index].size() :
+			(q.Path == query::FlatIndex) ? table.flatVector()[q.Index].size() : table.hashVector()[q.Index].size();
+		out << "Access path: " << (q.Path == query::FlatIndex ? "avl" : "hash") << " index on " << column
+		<< " (" << keys << " keys)" << '\n';
+		steps = (q.Path == query::FlatIndex) ? searches * searchDepth(keys) : 1;
+		fetched = FindRecords(table, q).size();
+		source = " (counted from the index)";
+	}
+	else if (q.Path == query::BtreeIndex) {
+		const btree& tree = table.btreeIndex(q.Index);
+		out << "Access path: B+tree index on " << column
+		<< " (height " << tree.height() << ", " << tree.pages() << " pages)" << '\n';
+		fetched = IndexSearch(tree, q.Where).size();
+		source = " (counted from the index)";
+		// a descent per bound, then the leaves the matches span
+		int64_t leaves = (tree.size() > 0) ? fetched * tree.pages() / tree.size() : 0;
+		steps = searches * (tree.height() + 1) + leaves;
+	}
+	else if (q.Path == query::Scan) {
+		const columnfile& columns = table.columns();
+		int type = table.columnTypes()[q.WhereColumn];
+		if (columns.isOpen() && (type == columnfile::String || q.Where.Op != "like")) {
+			out << "Access path: scan of " << column << " in " << table.name() << ".col" << '\n';
+			bytes = numRecords * (type == columnfile::String ? sizeof(uint32_t) : 8);
+		}
+		else {
+			out << "Access path: scan of " << column << " in " << table.name() << ".data";
+			workerpool* pool = table.scanPool();
+			if (pool != nullptr && pool->size() > 1) {
+				out << " (" << pool->size() << " threads)";
+			}
+			out << '\n';
+			bytes = table.data().length();
+		}
+		scanned = numRecords;
+		fetched = (int64_t) (numRecords * guessSelectivity(q.Where));
+		source = " (guessed)";
+	}
+	else if (q.Path == query::Combined) {
+		int numGroups = 0;
+		forEachGroup(q.Terms, [&](const term*, const term*) {	numGroups++;	});
+		out << "Access path: " << q.Terms.size() << " terms, " << numGroups
+		<< (numGroups == 1 ? " and-group" : " and-groups or-ed") << '\n';
+
+		bool scanData = false;
+		int group = 0;
+		forEachGroup(q.Terms, [&](const term* first, const term* last) {
+			groupplan plan = planGroup(table, first, last);
+			int64_t candidates = 0;
+			out << "  Group " << ++group << ": ";
+			if (plan.Empty) {
+				out << "matches nothing" << '\n';
+				return;
+			}
+			for (size_t k = 0; k < plan.Indexed.size(); k++) {
+				const term* t = plan.Indexed[k];
+				int searches = (t->Where.Op == "between") ? 2 : 1;
+				bool stale = (t->Path != query::BtreeIndex) && table.indexStale(t->Index);
+				out << (k > 0 ? " intersected with " : "")
+				<< (t->Path == query::FlatIndex ? "avl" : t->Path == query::HashIndex ? "hash" : "B+tree")
+				<< " index on " << table.columnVector()[t->Column] << " (" << plan.Estimates[k] << " records)";
+				steps += (t->Path == query::BtreeIndex) ? searches * (table.btreeIndex(t->Index).height() + 1) :
+					(t->Path == query::HashIndex && !stale) ? 1 :
+					searches * searchDepth(stale ? table.avlVector()[t->Index].size() : table.flatVector()[t->Index].size());
+				// each index after the first keeps the fraction of the records it finds
+				candidates = (k == 0) ? plan.Estimates[k] :
+					(numRecords > 0) ? candidates * plan.Estimates[k] / numRecords : 0;
+			}
+			if (plan.Indexed.empty() && plan.ColumnTerm >= 0) {
+				const term* t = plan.Residual[plan.ColumnTerm];
+				out << "scan of " << table.columnVector()[t->Column] << " in " << table.name() << ".col";
+				scanned += numRecords;
+				bytes += numRecords * (table.columnTypes()[t->Column] == columnfile::String ? sizeof(uint32_t) : 8);
+				candidates = (int64_t) (numRecords * guessSelectivity(t->Where));
+			}
+			else if (plan.Indexed.empty()) {
+				out << "scan of " << table.name() << ".data";
+				scanData = true;
+				candidates = numRecords;
+			}
+
+			bool tested = false;
+			for (size_t k = 0; k < plan.Residual.size(); k++) {
+				if ((int) k == plan.ColumnTerm) {
+					continue;
+				}
+				out << (tested ? " and " : ", testing ") << table.columnVector()[plan.Residual[k]->Column];
+				tested = true;
+			}
+			if (tested && (!plan.Indexed.empty() || plan.ColumnTerm >= 0)) { // the candidates are read to test them
+				scanned += candidates;
+				bytes += candidates * table.recordSize();
+			}
+			for (size_t k = 0; k < plan.Residual.size(); k++) {
+				if ((int) k != plan.ColumnTerm) {
+					candidates = (int64_t) (candidates * guessSelectivity(plan.Residual[k]->Where));
+				}
+			}
+			fetched += candidates;
+			out << '\n';
+		});
+		if (scanData) { // one scan for every group that needs it
+			scanned += numRecords;
+			bytes += table.data().length();
+		}
+		fetched = min(fetched, numRecords);
+		source = " (estimated)";
+	}
+	else {
+		out << "Access path: none, " << column << " can't be searched" << '\n';
+	}
+
+	out << "  Index steps: " << steps << '\n';
+	out << "  Records scanned: " << scanned << " (" << bytes << " bytes)" << '\n';
+	out << "  Records fetched: " << fetched << source << '\n';
+	out << "  Estimated cost: " << steps + scanned + fetched << '\n';
+
+}
+
+
+// prints the selected column (every column for -1, i.e. *) of the
+// records at the given positions, one "column: value" per line
+template<typename TPositions>
+static void printRecords(const dbtable& table, const TPositions& positions, int selectColumn, 
+			vector<string_view>& dataRecord, ostream& out) {
+
+	const vector<string>& columnVector = table.columnVector();
+	for (streamoff dataPos : positions) {
+		table.getRecord(dataPos, dataRecord);
+		for (unsigned j = 0; j < columnVector.size(); j++) {
+			if (selectColumn < 0 || selectColumn == (int) j) {
+				out << columnVector[j]
+				<< ": "
+				<< dataRecord[j]
+				<< '\n';
+			}
+		}
+	}
+
+}
+
+
+void SelectRecords(const dbtable& table, const query& q, vector<string_view>& dataRecord, ostream& out) {
+
+	if (!q.Aggregates.empty()) {
+		AggregateRecords(table, q, out);
+		return;
+	}
+
+	bool found = false;
+	if ((q.Path == query::HashIndex || (q.Path == query::FlatIndex && q.Where.Op == "=")) &&
+			q.Where.Valid && !table.indexStale(q.Index)) {
+		// point lookup, print straight from the index
+		positionrange postings = (q.Path == query::HashIndex) ?
+			table.hashVector()[q.Index].find(q.Where.Key) : table.flatVector()[q.Index].find(q.Where.Key);
+		if (!postings.empty()) {
+			found = true;
+			printRecords(table, postings, q.SelectColumn, dataRecord, out);
+		}
+	}
+	else if (q.Path != query::NoPath) {
+		vector<streamoff> dataPosVector = FindRecords(table, q);
+		if (!dataPosVector.empty()) {
+			found = true;
+			printRecords(table, dataPosVector, q.SelectColumn, dataRecord, out);
+		}
+	}
+
+	if (found == false) { // whereData does not exist
+		out << "Not found..."
+		<< '\n';
+	}
+
+}
+
+
+void WriteRecords(dbtable& table, const query& q, ostream& out) {
+
+	lock_guard<mutex> writer(table.writeLock());
+	vector<streamoff> deletes;
+	vector<string> records;
+	string record;
+	if (q.Kind == query::Insert) {
+		if (!FormatRecord(q.Values, table.recordSize(), record)) {
+			out << "Record too long, ignored..."
+			<< '\n';
+			return;
+		}
+		records.push_back(record);
+	}
+	else {
+		deletes = FindRecords(table, q);
+		if (deletes.empty()) {
+			out << "Not found..."
+			<< '\n';
+			return;
+		}
+	}
+	if (q.Kind == query::Update) { // each record again, with its new value
+		vector<string_view> dataRecord;
+		vector<string> values;
+		for (streamoff pos : deletes) {
+			GetRecord(table.data(), pos, dataRecord);
+			values.assign(dataRecord.begin(), dataRecord.end());
+			values[q.SetColumn] = q.Values[0];
+			if (!FormatRecord(values, table.recordSize(), record)) {
+				out << "Record too long, ignored..."
+				<< '\n';
+				return;
+			}
+			records.push_back(record);
+		}
+	}
+
+	if (!table.write(deletes, records, out)) {
+		return;
+	}
+	size_t count = (q.Kind == query::Insert) ? records.size() : deletes.size();
+	const char* done = (q.Kind == query::Insert) ? " inserted." : (q.Kind == query::Update) ? " updated." : " deleted.";
+	out << count
+	<< (count == 1 ? " record" : " records")
+	<< done
+	<< '\n';
+
+}
+
+
+plancache::plancache(dbtable& table) {
+
+	Table = &table;
+	Hits = 0;
+	Misses = 0;
+
+}
+
+
+// the plan for text, with text's values filled in.  Parses text only if
+// no query of the same shape was seen before.  The plan returned is
+// valid until the next prepare.
+const query& plancache::prepare(string_view text) {
+
+	splitTokens(text, Tokens);
+	if (isWrite(Tokens)) {
+		parseTokens(*Table, Tokens, Write);
+		return Write;
+	}
+
+	// the shape: the where clause's values become ?.  Nothing parsing
+	// looks at is a value, so a shape is valid or not, with the same
+	// error, whatever its values are.
+	whereValues(Tokens, 4, ValueTokens);
+	Shape.clear();
+	size_t v = 0;
+	for (size_t i = 0; i < Tokens.size(); i++) {
+		if (i > 0) {
+			Shape += ' ';
+		}
+		if (v < ValueTokens.size() && ValueTokens[v] == i) {
+			Shape += '?';
+			v++;
+		}
+		else {
+			Shape.append(Tokens[i].data(), Tokens[i].size());
+		}
+	}
+
+	auto found = Plans.find(Shape);
+	if (found == Plans.end()) {
+		Misses++;
+		if (Plans.size() >= Capacity) {
+			Plans.clear();
+		}
+		found = Plans.emplace(Shape, query()).first;
+		parseTokens(*Table, Tokens, found->second);
+		return found->second;
+	}
+
+	Hits++;
+	query& q = found->second;
+	if (q.Valid && q.WhereColumn >= 0) { // each term's values, in order
+		size_t next = 0;
+		auto fill = [&](predicate& where) {
+			where.Value.assign(Tokens[ValueTokens[next]].data(), Tokens[ValueTokens[next]].size());
+			next++;
+			if (where.Op == "between") {
+				where.Value2.assign(Tokens[ValueTokens[next]].data(), Tokens[ValueTokens[next]].size());
+				next++;
+			}
+			where.prepare(where.Type);
+		};
+		if (q.Terms.empty()) {
+			fill(q.Where);
+		}
+		for (term& t : q.Terms) {
+			fill(t.Where);
+		}
+	}
+	return q;
+
+}
@@ -0,0 +1,173 @@
+#ifndef QUERY_H
+#define QUERY_H
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include "util.h"
+#include "table.h"
+using namespace std;
+
+
+// One aggregate of an aggregate query: count(*), or sum, avg, min or max
+// of a column.  sum and avg take int and double columns; min and max
+// take any column, compared in its type's order.
+struct aggregate {
+
+	static const int Count = 0;
+	static const int Sum = 1;
+	static const int Avg = 2;
+	static const int Min = 3;
+	static const int Max = 4;
+
+	int    Function;
+	int    Column;  // ordinal of the column, -1 for count(*)
+	string Name;    // as written, e.g. "avg(latitude)"
+
+};
+
+
+// One term of a where clause of several: "col op value" or "col
+// between value and value", the access path that would answer it alone,
+// and whether it is joined to the term before it by or, rather than
+// and.  and binds tighter than or, so the clause is an or of and-groups:
+// "a = 1 and b = 2 or c = 3" is (a = 1 and b = 2) or c = 3.
+struct term {
+
+	int       Column;
+	predicate Where;
+	int       Path;
+	int       Index;  // the table's index # for index paths
+	bool      Or;
+
+};
+
+
+// A parsed query, with its column names resolved to ordinals and the
+// way to find its records already chosen:
+//   select col|* from table where col op value     (op is = < <= > >= like)
+//   select col|* from table where col between value and value
+//   select agg,agg,... from table [where ...] [group by col]
+//   insert into table values value value ...       (one per column)
+//   update table set col = value where ...
+//   delete from table where ...
+// where agg is count(*), sum(col), avg(col), min(col) or max(col), and
+// the where clause of the others is the same as select's.  A value
+// inserted or set in a column .meta types int or double must be one.  A where
+// clause may join any number of terms with and and or: "where col op
+// value and col op value or ...".
+struct query {
+
+	// kinds of query
+	static const int Select = 0;
+	static const int Insert = 1;
+	static const int Update = 2;
+	static const int Delete = 3;
+
+	// access paths: how the where clause is answered
+	static const int NoPath = 0;      // column can't be searched, nothing matches
+	static const int Scan = 1;        // scan the column (.col file, else .data)
+	static const int FlatIndex = 2;   // frozen avl index
+	static const int HashIndex = 3;   // hash index, = only
+	static const int BtreeIndex = 4;  // B+tree index
+	static const int Combined = 5;    // several terms, each with its own path (see FindRecords)
+
+	bool      Valid;
+	string    Error;         // why the query was rejected, if not Valid
+	int       Kind;
+	int       SelectColumn;  // ordinal of the selected column, -1 for *
+	vector<aggregate> Aggregates;  // select: the aggregates, if it is an aggregate query
+	int       GroupColumn;   // ordinal of the group by column, -1 if none
+	int       SetColumn;     // update: ordinal of the column set
+	vector<string> Values;   // insert: the record's values; update: the value set
+	int       WhereColumn;   // ordinal of the where column (the first term's), -1 if there is no where clause
+	predicate Where;
+	int       Path;
+	int       Index;         // the table's index # for index paths
+	vector<term> Terms;      // a where clause of several terms (Path is Combined): every term
+
+};
+
+
+// parses text into q, checking it against table's columns and choosing
+// its access path.  Invalid queries come back with Valid false and the
+// reason in Error.
+void ParseQuery(const dbtable& table, string_view text, query& q);
+
+
+// the positions of the records matching a parsed query's where clause,
+// found along the access path chosen when it was parsed: the where
+// column's index, or a scan of the column.  A where clause of several
+// terms is answered one and-group at a time, in positions' order: the
+// group's most selective index finds candidates, intersected with the
+// positions other indexes find (where they find few enough to be worth
+// reading), before any record is read; the group's other terms are then
+// tested on each candidate.  Groups with no index are scanned together,
+// testing every term of each on each record in one pass.  The groups'
+// positions are merged.
+vector<streamoff> FindRecords(const dbtable& table, const query& q);
+
+
+// finds every record matching a parsed query's where clause (see
+// FindRecords) and prints the selected column(s) of each, "Not found..."
+// if there are none.  dataRecord is scratch space for the records,
+// reused across calls so lookups don't allocate.  Aggregate queries are
+// handed to AggregateRecords.
+void SelectRecords(const dbtable& table, const query& q, vector<string_view>& dataRecord, ostream& out);
+
+
+// inserts, updates or deletes records for a parsed insert, update or
+// delete query, and prints how many, "Not found..." if the where clause
+// matches none.  An update deletes each record it matches and appends
+// it again with its new value.  Takes the table's write lock, so
+// writers run one at a time.
+void WriteRecords(dbtable& table, const query& q, ostream& out);
+
+
+// writes how a parsed query would be answered --- its access path --- and
+// what that should cost, without reading any records: the index steps
+// to find the matches, the records a scan tests and the bytes it reads,
+// and the records fetched to print the matches.  Index paths count the
+// matches from the index; scans guess them from the operator.  A where
+// clause of several terms lists the plan of each and-group.  An
+// aggregate query first says where its values come from (see
+// AggregateSource).
+void ExplainQuery(const dbtable& table, const query& q, ostream& out);
+
+
+// Remembers parsed queries by their shape: the query text with its
+// values replaced by ?, so "select * from t where id = 5" and "... id = 6"
+// share one plan and only the values are filled in on a repeat.  Holds
+// at most Capacity shapes, and starts over when full.  Inserts, updates
+// and deletes are parsed every time, not cached.  One per thread; not
+// locked.
+class plancache {
+
+private:
+
+	static const size_t Capacity = 1024;
+
+	dbtable*                      Table;
+	unordered_map<string, query>  Plans;
+	query                         Write;   // the last insert, update or delete
+	vector<string_view>           Tokens;  // scratch, reused by every prepare
+	vector<size_t>                ValueTokens;  // scratch: which of Tokens are the where clause's values
+	string                        Shape;   // scratch, reused by every prepare
+	int64_t                       Hits, Misses;
+
+public:
+
+	explicit plancache(dbtable& table);
+
+	const query& prepare(string_view text);
+
+	dbtable& table() const  {	return *Table;	}
+
+	int64_t hits() const    {	return Hits;	}
+	int64_t misses() const  {	return Misses;	}
+
+};
+
+#endif
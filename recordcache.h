@@ -0,0 +1,195 @@
+#ifndef RECORDCACHE_H
+#define RECORDCACHE_H
+
+#include <iostream>
+#include <vector>
+#include <string_view>
+#include <mutex>
+#include <algorithm>
+#include <cstdint>
+#include "util.h"
+#include "stats.h"
+using namespace std;
+
+
+// Bounded cache of parsed records in front of GetRecord, for tables whose
+// hot records are looked up again and again.  A table owns one cache, so
+// entries are keyed by (table, file position).  A record is cached as
+// where each of its values starts and ends, relative to the record, so a
+// hit rebuilds the string_views into the mapping without tokenizing it
+// again.  Positions are found through a linear probing table, and eviction
+// is CLOCK: each entry has a referenced bit set on every hit, and the hand
+// clears bits until it finds an entry not used since its last pass.
+// Locked, so queries on several threads can share it --- but with one
+// mutex, which every lookup takes, so threads doing point lookups at
+// once take turns here.  The server leaves it off unless asked (see
+// main.cpp).
+class recordcache {
+
+private:
+
+	struct ENTRY {
+		streamoff Pos;         // -1 if unused
+		bool      Referenced;  // hit since the hand last passed
+	};
+
+	size_t    Capacity;    // most records kept; 0 turns the cache off
+	int       NumColumns;
+	vector<ENTRY>    Entries;
+	vector<uint32_t> Fields;  // entry i's values: NumColumns (start, length) pairs at 2*NumColumns*i
+	vector<uint32_t> Table;   // open addressing, position -> entry + 1 (0 if empty)
+	uint64_t  Mask;           // Table.size() - 1
+	int       Shift;          // 64 - log2(Table.size())
+	size_t    Hand;
+	int64_t   Hits, Misses;
+	mutex     Lock;
+
+
+	// home slot of a position in Table (Fibonacci hashing)
+	size_t _home(streamoff pos) const {
+
+		return ((uint64_t) pos * 0x9E3779B97F4A7C15ULL) >> Shift;
+
+	}
+
+
+	// Table slot holding pos, or of the empty slot ending its probe sequence
+	size_t _find(streamoff pos) const {
+
+		size_t slot = _home(pos);
+		while (Table[slot] != 0 && Entries[Table[slot] - 1].Pos != pos) {
+			slot = (slot + 1) & Mask;
+		}
+		return slot;
+
+	}
+
+
+	// empties Table slot, moving later entries of the probe sequence back
+	// so every entry stays reachable from its home slot
+	void _erase(size_t slot) {
+
+		size_t next = slot;
+		while (true) {
+			next = (next + 1) & Mask;
+			if (Table[next] == 0) {
+				break;
+			}
+			size_t home = _home(Entries[Table[next] - 1].Pos);
+			// next can move to slot unless its home lies cyclically in (slot, next]
+			bool stays = (slot < next) ? (home > slot && home <= next) : (home > slot || home <= next);
+			if (!stays) {
+				Table[slot] = Table[next];
+				slot = next;
+			}
+		}
+		Table[slot] = 0;
+
+	}
+
+public:
+
+	recordcache() {	Capacity = 0; NumColumns = 0; Mask = 0; Shift = 64; Hand = 0; Hits = 0; Misses = 0;	}
+
+	recordcache(const recordcache& other) = delete;
+	recordcache& operator=(const recordcache& other) = delete;
+
+
+	// empties the cache and sizes it for capacity records of numColumns values
+	void reset(size_t capacity, int numColumns) {
+
+		lock_guard<mutex> guard(Lock);
+		Capacity = capacity;
+		NumColumns = numColumns;
+		Entries.assign(capacity, ENTRY{ -1, false });
+		Fields.assign(capacity * 2 * numColumns, 0);
+		size_t tableSize = 16;
+		Shift = 60;
+		while (tableSize < 2 * capacity) {
+			tableSize *= 2;
+			Shift--;
+		}
+		Table.assign(capacity > 0 ? tableSize : 0, 0);
+		Mask = tableSize - 1;
+		Hand = 0;
+		Hits = 0;
+		Misses = 0;
+
+	}
+
+
+	// empties the cache, keeping its size and counts; after records
+	// have moved, as they do when a table is compacted
+	void clear() {
+
+		lock_guard<mutex> guard(Lock);
+		for (ENTRY& entry : Entries) {
+			entry = ENTRY{ -1, false };
+		}
+		fill(Table.begin(), Table.end(), 0);
+		Hand = 0;
+
+	}
+
+
+	size_t  capacity() const  {	return Capacity;	}
+	int64_t hits() const      {	return Hits;	}
+	int64_t misses() const    {	return Misses;	}
+
+
+	// same as GetRecord, but answered from the cache when the record
+	// at pos was read before and is still cached.
+	void get(const datafile& table, streamoff pos, vector<string_view>& values) {
+
+		CountStat(&querystats::RecordsFetched, 1);
+		if (Capacity == 0) {
+			CountStat(&querystats::BytesRead, table.recordSize());
+			GetRecord(table, pos, values);
+			return;
+		}
+
+		const char* record = table.data() + pos;
+		lock_guard<mutex> guard(Lock);
+		size_t slot = _find(pos);
+		if (Table[slot] != 0) { // hit
+			uint32_t entry = Table[slot] - 1;
+			Hits++;
+			CountStat(&querystats::CacheHits, 1);
+			Entries[entry].Referenced = true;
+			const uint32_t* fields = Fields.data() + 2 * NumColumns * entry;
+			values.resize(NumColumns);
+			for (int i = 0; i < NumColumns; i++) {
+				values[i] = string_view(record + fields[2 * i], fields[2 * i + 1]);
+			}
+			return;
+		}
+
+		Misses++;
+		CountStat(&querystats::BytesRead, table.recordSize());
+		GetRecord(table, pos, values);
+
+		// the hand moves to the first entry not referenced since it last
+		// passed, clearing bits on the way; that entry is replaced
+		while (Entries[Hand].Referenced) {
+			Entries[Hand].Referenced = false;
+			Hand = (Hand + 1) % Capacity;
+		}
+		ENTRY& victim = Entries[Hand];
+		if (victim.Pos >= 0) {
+			_erase(_find(victim.Pos));
+		}
+		victim.Pos = pos;
+		victim.Referenced = false;
+		Table[_find(pos)] = Hand + 1;
+		uint32_t* fields = Fields.data() + 2 * NumColumns * Hand;
+		for (int i = 0; i < NumColumns && i < (int) values.size(); i++) {
+			fields[2 * i] = values[i].data() - record;
+			fields[2 * i + 1] = values[i].size();
+		}
+		Hand = (Hand + 1) % Capacity;
+
+	}
+
+};
+
+#endif
@@ -0,0 +1,157 @@
+#ifndef SLABPOOL_H
+#define SLABPOOL_H
+
+#include <cstddef>
+#include <new>
+#include <utility>  // std::swap
+#include <vector>
+using namespace std;
+
+
+// Node storage policies for avltree.  A pool hands out raw, uninitialized
+// storage for one T at a time; the tree constructs and destroys the T in
+// place.  ReleasesAll tells the tree whether release() frees every
+// allocation at once, in which case it never calls deallocate().
+
+
+// Carves nodes out of large contiguous slabs.  Slabs grow geometrically
+// so small trees stay small, and freed nodes are reused through a free
+// list.  release() gives back a whole slab at a time.
+template<typename T>
+class slabpool {
+
+private:
+
+	// a freed node's storage is reused to link the free list
+	union SLOT {
+		SLOT* Next;
+		alignas(T) unsigned char Storage[sizeof(T)];
+	};
+
+	vector<SLOT*> Slabs;     // every slab allocated, freed by release()
+	SLOT*         Cur;       // next unused slot in the newest slab
+	SLOT*         End;       // one past the last slot in the newest slab
+	SLOT*         FreeList;  // slots given back by deallocate()
+	size_t        NextSize;  // # of slots in the next slab
+
+	static const size_t MinSlab = 256;
+	static const size_t MaxSlab = 65536;
+
+
+	void _newslab(size_t count) {
+
+		SLOT* slab = static_cast<SLOT*>(::operator new(count * sizeof(SLOT)));
+		Slabs.push_back(slab);
+		Cur = slab;
+		End = slab + count;
+
+	}
+
+public:
+
+	static const bool ReleasesAll = true;
+
+	slabpool() {
+
+		Cur = End = FreeList = nullptr;
+		NextSize = MinSlab;
+
+	}
+
+	// pools are never shared, a copied tree gets its own
+	slabpool(const slabpool& other) : slabpool() { }
+	slabpool& operator=(const slabpool& other) {	return *this;	}
+
+	// a moved tree takes its nodes' slabs along with it
+	slabpool(slabpool&& other) noexcept : slabpool() {	swap(other);	}
+	slabpool& operator=(slabpool&& other) noexcept {
+
+		release();
+		swap(other);
+		return *this;
+
+	}
+
+	~slabpool() {	release();	}
+
+
+	// makes sure the next count allocations come from one slab, so a tree
+	// of known size is laid out contiguously.
+	void reserve(size_t count) {
+
+		if ((size_t) (End - Cur) < count) {
+			_newslab(count);
+		}
+
+	}
+
+
+	T* allocate() {
+
+		if (FreeList != nullptr) {
+			SLOT* slot = FreeList;
+			FreeList = slot->Next;
+			return reinterpret_cast<T*>(slot->Storage);
+		}
+		if (Cur == End) {
+			_newslab(NextSize);
+			if (NextSize < MaxSlab) {
+				NextSize *= 2;
+			}
+		}
+		return reinterpret_cast<T*>((Cur++)->Storage);
+
+	}
+
+
+	void deallocate(T* p) {
+
+		SLOT* slot = reinterpret_cast<SLOT*>(p);
+		slot->Next = FreeList;
+		FreeList = slot;
+
+	}
+
+
+	void swap(slabpool& other) noexcept {
+
+		Slabs.swap(other.Slabs);
+		std::swap(Cur, other.Cur);
+		std::swap(End, other.End);
+		std::swap(FreeList, other.FreeList);
+		std::swap(NextSize, other.NextSize);
+
+	}
+
+
+	// frees every slab; all storage handed out becomes invalid.
+	void release() {
+
+		for (SLOT* slab : Slabs) {
+			::operator delete(slab);
+		}
+		Slabs.clear();
+		Cur = End = FreeList = nullptr;
+		NextSize = MinSlab;
+
+	}
+
+};
+
+
+// One heap allocation per node, the way avltree originally worked.
+template<typename T>
+class heappool {
+
+public:
+
+	static const bool ReleasesAll = false;
+
+	void reserve(size_t count) { }
+	T* allocate() {	return static_cast<T*>(::operator new(sizeof(T)));	}
+	void deallocate(T* p) {	::operator delete(p);	}
+	void release() { }
+
+};
+
+#endif
@@ -0,0 +1,149 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <iostream>
+#include <mutex>
+#include <cstdint>
+using namespace std;
+
+
+// The work one query did, counted where it is done: in the scans, the
+// index searches and the record cache.
+struct querystats {
+
+	int64_t RecordsScanned;  // records (or column values) a scan tested
+	int64_t BytesRead;       // bytes scanned, parsed or read in from disk
+	int64_t NodesVisited;    // avl nodes, flat index levels, hash slots and B+tree pages looked at
+	int64_t RecordsFetched;  // records read to print them
+	int64_t CacheHits;       // ... of which the record cache answered
+
+	querystats() {	clear();	}
+
+	void clear() {
+
+		RecordsScanned = 0;
+		BytesRead = 0;
+		NodesVisited = 0;
+		RecordsFetched = 0;
+		CacheHits = 0;
+
+	}
+
+	void add(const querystats& other) {
+
+		RecordsScanned += other.RecordsScanned;
+		BytesRead += other.BytesRead;
+		NodesVisited += other.NodesVisited;
+		RecordsFetched += other.RecordsFetched;
+		CacheHits += other.CacheHits;
+
+	}
+
+};
+
+
+// the counters of the query running on this thread; nullptr while stats
+// are off, so counting costs one test of a thread-local pointer.  Work
+// handed to a worker pool is counted by the thread that handed it out.
+inline thread_local querystats* QueryStats = nullptr;
+
+
+// adds n to one counter of the query running on this thread, if any
+inline void CountStat(int64_t querystats::*counter, int64_t n) {
+
+	if (QueryStats != nullptr) {
+		QueryStats->*counter += n;
+	}
+
+}
+
+
+// Counters summed over every query run with stats on, and a histogram of
+// their latencies in power of 2 buckets.  Locked, so the server's
+// threads can share one.
+class statstotals {
+
+private:
+
+	static const int NumBuckets = 24;  // bucket 0: under 1 us; bucket i: [2^(i-1), 2^i) us; the last: the rest
+
+	querystats Totals;
+	int64_t    Queries;
+	double     TotalMicros, MaxMicros;
+	int64_t    Buckets[NumBuckets];
+	mutex      Lock;
+
+public:
+
+	statstotals() {	clear();	}
+
+
+	void clear() {
+
+		lock_guard<mutex> guard(Lock);
+		Totals.clear();
+		Queries = 0;
+		TotalMicros = 0;
+		MaxMicros = 0;
+		for (int i = 0; i < NumBuckets; i++) {
+			Buckets[i] = 0;
+		}
+
+	}
+
+
+	// adds one query's counters and latency
+	void add(const querystats& stats, double micros) {
+
+		int bucket = 0;
+		while (bucket < NumBuckets - 1 && micros >= (double) (1LL << bucket)) {
+			bucket++;
+		}
+		lock_guard<mutex> guard(Lock);
+		Totals.add(stats);
+		Queries++;
+		TotalMicros += micros;
+		if (micros > MaxMicros) {
+			MaxMicros = micros;
+		}
+		Buckets[bucket]++;
+
+	}
+
+
+	void print(ostream& out) {
+
+		lock_guard<mutex> guard(Lock);
+		out << "Queries: " << Queries << '\n';
+		out << "  Records scanned: " << Totals.RecordsScanned << '\n';
+		out << "  Bytes read: " << Totals.BytesRead << '\n';
+		out << "  Index nodes visited: " << Totals.NodesVisited << '\n';
+		out << "  Records fetched: " << Totals.RecordsFetched
+		<< " (" << Totals.CacheHits << " from the record cache)" << '\n';
+		if (Queries == 0) {
+			return;
+		}
+		out << "  Latency mean: " << TotalMicros / Queries << " us, max: " << MaxMicros << " us" << '\n';
+		out << "  Latency histogram:" << '\n';
+		for (int i = 0; i < NumBuckets; i++) {
+			if (Buckets[i] == 0) {
+				continue;
+			}
+			out << "    ";
+			if (i == 0) {
+				out << "< 1 us";
+			}
+			else if (i == NumBuckets - 1) {
+				out << ">= " << (1LL << (i - 1)) << " us";
+			}
+			else {
+				out << (1LL << (i - 1)) << "-" << (1LL << i) << " us";
+			}
+			out << ": " << Buckets[i] << '\n';
+		}
+
+	}
+
+};
+
+#endif
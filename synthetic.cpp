@@ -0,0 +1,128 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <random>
+#include <algorithm>
+#include "synthetic.h"
+using namespace std;
+
+
+// draws values in [0, n) from one of the distributions of tablespec
+class valuesource {
+
+private:
+
+	int64_t N;
+	int     Kind;        // 0 uniform, 1 zipf, 2 sequential
+	vector<double> Cdf;  // zipf: P(value <= k)
+	mt19937_64& Rng;
+
+public:
+
+	valuesource(int64_t n, int kind, mt19937_64& rng) : N(n), Kind(kind), Rng(rng) {
+
+		if (Kind == 1) {
+			double total = 0;
+			Cdf.resize(N);
+			for (int64_t k = 0; k < N; k++) {
+				total += 1.0 / (k + 1);
+				Cdf[k] = total;
+			}
+			for (double& p : Cdf) {
+				p /= total;
+			}
+		}
+
+	}
+
+
+	int64_t next(int64_t row) {
+
+		if (Kind == 2) {
+			return row % N;
+		}
+		else if (Kind == 1) {
+			double u = uniform_real_distribution<double>(0, 1)(Rng);
+			return min<int64_t>(N - 1, lower_bound(Cdf.begin(), Cdf.end(), u) - Cdf.begin());
+		}
+		return uniform_int_distribution<int64_t>(0, N - 1)(Rng);
+
+	}
+
+};
+
+
+// # of decimal digits in n
+static int digits(int64_t n) {
+
+	int count = 1;
+	while (n >= 10) {
+		n /= 10;
+		count++;
+	}
+	return count;
+
+}
+
+
+string SyntheticColumn(int column) {
+
+	if (column == 0) {
+		return "id";
+	}
+	return (column % 2 == 1 ? "key" : "num") + to_string(column);
+
+}
+
+
+bool WriteTable(const tablespec& spec, ostream& errors) {
+
+	int kind = (spec.Distribution == "uniform") ? 0 : (spec.Distribution == "zipf") ? 1 :
+		(spec.Distribution == "sequential") ? 2 : -1;
+	if (kind < 0) {
+		errors << "**Error: unknown distribution '" << spec.Distribution << "'." << endl;
+		return false;
+	}
+	if (spec.Rows <= 0 || spec.Columns <= 0) {
+		errors << "**Error: a table needs at least one row and one column." << endl;
+		return false;
+	}
+	int64_t distinct = (spec.Distinct > 0) ? spec.Distinct : spec.Rows;
+
+	// every record is as long as the longest one could be, plus a
+	// trailing space before the padding and the \r\n
+	int recordSize = digits(spec.Rows - 1) + 3;
+	for (int c = 1; c < spec.Columns; c++) {
+		recordSize += 1 + (c % 2 == 1 ? 1 : 0) + digits(distinct - 1);
+	}
+
+	ofstream meta(spec.Name + ".meta", ios::out | ios::trunc);
+	ofstream data(spec.Name + ".data", ios::out | ios::binary | ios::trunc);
+	if (!meta.good() || !data.good()) {
+		errors << "**Error: couldn't write table '" << spec.Name << "'." << endl;
+		return false;
+	}
+	meta << recordSize << '\n' << spec.Columns << '\n';
+	for (int c = 0; c < spec.Columns; c++) {
+		bool indexed = find(spec.Indexed.begin(), spec.Indexed.end(), c) != spec.Indexed.end();
+		meta << SyntheticColumn(c) << (c % 2 == 0 ? ":int " : " ") << (indexed ? spec.IndexKind : "0") << '\n';
+	}
+
+	mt19937_64 rng(spec.Seed);
+	valuesource values(distinct, kind, rng);
+	string record;
+	for (int64_t row = 0; row < spec.Rows; row++) {
+		record = to_string(row);
+		for (int c = 1; c < spec.Columns; c++) {
+			record += (c % 2 == 1) ? " k" : " ";
+			record += to_string(values.next(row));
+		}
+		record += ' ';
+		record.resize(recordSize - 2, '.');
+		record += "\r\n";
+		data.write(record.data(), record.size());
+	}
+	return data.good();
+
+}
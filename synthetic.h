@@ -0,0 +1,44 @@
+#ifndef SYNTHETIC_H
+#define SYNTHETIC_H
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstdint>
+using namespace std;
+
+
+// A synthetic table, for benchmarks: Rows fixed size records of Columns
+// values, written as Name.data and Name.meta.  Column 0, "id", numbers
+// the rows 0, 1, 2, ...; the others alternate between strings ("key1",
+// "key3", ... holding "k" and a number) and ints ("num2", "num4", ...),
+// each drawn from Distinct values by Distribution:
+//   uniform     every value equally likely
+//   zipf        value k with probability proportional to 1/(k+1), so a
+//               few values are in most records
+//   sequential  row r gets value r % Distinct
+struct tablespec {
+
+	string   Name;
+	int64_t  Rows;
+	int      Columns;
+	int64_t  Distinct;      // values per column but id; 0 for as many as Rows
+	string   Distribution;
+	vector<int> Indexed;    // columns marked indexed in the .meta
+	string   IndexKind;     // their .meta flag: "1" (avl), "btree" or "hash"
+	uint32_t Seed;
+
+	tablespec() {	Rows = 10000; Columns = 4; Distinct = 0; Distribution = "uniform"; IndexKind = "1"; Seed = 12345;	}
+
+};
+
+
+// name of column i of a synthetic table: id, key1, num2, key3, ...
+string SyntheticColumn(int column);
+
+
+// writes spec's Name.data and Name.meta.  Returns false, after writing
+// why to errors, if spec can't be written.
+bool WriteTable(const tablespec& spec, ostream& errors);
+
+#endif
@@ -0,0 +1,710 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <numeric>
+#include <cstdio>  // rename, remove
+#include <fcntl.h>
+#include <unistd.h>
+#include "table.h"
+using namespace std;
+
+
+// given the meta filename, return a vector with all data in file
+vector<string> createMetaVector(string tablename) {
+
+	vector<string> metaVector;
+	// open the file, make sure it opened, seekg to the given position,
+	// loop and input values using >>, store into vector, return vector
+	string filename = tablename + ".meta";
+	ifstream data(filename, ios::in | ios::binary);
+
+	if (!data.good()) {
+		cout << "**Error: couldn't open data file '" << filename << "'." << endl;
+		return metaVector;
+	}
+
+	// input all data from .meta to value
+	// then, store .meta data into vector
+	string value;
+	data >> value;
+	while (!data.eof()) {
+		metaVector.push_back(value);
+		data >> value;
+	}
+	return metaVector;
+
+}
+
+
+// one column's values, each paired with the position of its record
+typedef vector<pair<string_view, streamoff>> columnpairs;
+
+
+// one streaming pass over the mapped .data file: each record is
+// tokenized once, and its value in each of the given columns is added,
+// with the record's position, to that column's pairs, in file order.
+// With a pool, the file is split into chunks tokenized in parallel, and
+// the chunks' pairs are joined back in file order.  Deleted records are
+// skipped.
+static void collectColumns(const datafile& data, const vector<int>& columns, workerpool* pool, vector<columnpairs>& pairs) {
+
+	const streamoff MinChunkRecords = 4096; // smaller chunks aren't worth a task
+	streamoff numRecords = (data.recordSize() > 0) ? (data.length() + data.recordSize() - 1) / data.recordSize() : 0;
+	int numChunks = 1;
+	if (pool != nullptr) {
+		numChunks = (int) max((streamoff) 1, min((streamoff) pool->size() * 4, numRecords / MinChunkRecords));
+	}
+
+	// chunkPairs[chunk][c]: pairs of column c from that chunk's records
+	vector<vector<columnpairs>> chunkPairs(numChunks, vector<columnpairs>(columns.size()));
+	auto collectChunk = [&](int chunk) {
+		streamoff first = numRecords * chunk / numChunks;
+		streamoff last = numRecords * (chunk + 1) / numChunks;
+		vector<string_view> values;
+		vector<columnpairs>& out = chunkPairs[chunk];
+		for (columnpairs& column : out) {
+			column.reserve(last - first);
+		}
+		for (streamoff record = first; record < last; record++) {
+			streamoff pos = record * data.recordSize();
+			if (data.deleted(pos)) {
+				continue;
+			}
+			GetRecord(data, pos, values);
+			for (unsigned c = 0; c < columns.size(); c++) {
+				out[c].push_back(make_pair(values[columns[c]], pos));
+			}
+		}
+	};
+	if (numChunks > 1) {
+		pool->parallel_for(numChunks, collectChunk);
+	}
+	else {
+		collectChunk(0);
+	}
+
+	pairs.assign(columns.size(), columnpairs());
+	for (unsigned c = 0; c < columns.size(); c++) {
+		if (numChunks == 1) {
+			pairs[c].swap(chunkPairs[0][c]);
+			continue;
+		}
+		pairs[c].reserve(numRecords);
+		for (int chunk = 0; chunk < numChunks; chunk++) {
+			pairs[c].insert(pairs[c].end(), chunkPairs[chunk][c].begin(), chunkPairs[chunk][c].end());
+			columnpairs().swap(chunkPairs[chunk][c]);
+		}
+	}
+
+}
+
+
+// sort by key (stable, so positions of equal keys stay in file order)
+static void sortPairs(columnpairs& pairs) {
+
+	stable_sort(pairs.begin(), pairs.end(),
+		[](const pair<string_view, streamoff>& a, const pair<string_view, streamoff>& b) {
+			return a.first < b.first;
+		});
+
+}
+
+
+// populate index with a column's pairs: index column as key and line positions of
+// records as value; records with the same key are kept in file order in that key's posting list.
+// Values of a number column are parsed first, and those that aren't numbers are left out.
+static void populateAvlTree(columnpairs& pairs, keyindex& index) {
+
+	index.visit([&](auto& tree) {
+		typedef typename remove_reference<decltype(tree)>::type::key_type TKey;
+		vector<pair<TKey, postinglist>> grouped;
+
+		// group equal keys into one posting list each
+		if constexpr (is_same<TKey, fieldkey>::value) {
+			sortPairs(pairs);
+			for (const pair<string_view, streamoff>& p : pairs) {
+				if (grouped.empty() || string_view(grouped.back().first) != p.first) {
+					grouped.push_back(make_pair(fieldkey(p.first), postinglist())); // a view of the first record's value
+				}
+				grouped.back().second.push_back(p.second);
+			}
+		}
+		else {
+			vector<pair<TKey, streamoff>> keyed;
+			keyed.reserve(pairs.size());
+			TKey key;
+			for (const pair<string_view, streamoff>& p : pairs) {
+				if (ParseKey(p.first, key)) {
+					keyed.push_back(make_pair(key, p.second));
+				}
+			}
+			stable_sort(keyed.begin(), keyed.end(),
+				[](const pair<TKey, streamoff>& a, const pair<TKey, streamoff>& b) {
+					return a.first < b.first;
+				});
+			for (const pair<TKey, streamoff>& p : keyed) {
+				if (grouped.empty() || grouped.back().first != p.first) {
+					grouped.push_back(make_pair(p.first, postinglist()));
+				}
+				grouped.back().second.push_back(p.second);
+			}
+		}
+		tree.bulkload(grouped); // already sorted, builds a balanced tree in one pass
+	});
+
+}
+
+
+// opens the B+tree saved by a previous run.  Returns true if it was
+// built from this .data file, with keys of this type, false if it has
+// to be rebuilt.
+static bool openBtree(string filename, const datafile& table, uint64_t checksum, int type, btree& tree, size_t cachePages) {
+
+	if (!tree.open(filename, cachePages)) {
+		return false;
+	}
+	const int64_t* stamp = tree.stamp();
+	return stamp[0] == (int64_t) table.length() && stamp[1] == (int64_t) table.modTime() &&
+		stamp[2] == (int64_t) checksum && stamp[3] == type;
+
+}
+
+
+// creates the B+tree file and bulk loads it with a column's pairs, keyed
+// as IndexKey gives them for the column's type
+static void populateBtree(columnpairs& pairs, int type, string filename, const datafile& table, uint64_t checksum,
+			btree& tree, size_t cachePages) {
+
+	if (!tree.create(filename, cachePages)) {
+		return;
+	}
+	if (type == columnfile::String) {
+		sortPairs(pairs); // cheaper on views than on the keys below
+	}
+	vector<pair<string, streamoff>> entries;
+	entries.reserve(pairs.size());
+	string key;
+	for (const pair<string_view, streamoff>& p : pairs) {
+		if (IndexKey(type, p.first, key)) {
+			entries.push_back(make_pair(key, p.second));
+		}
+	}
+	if (type != columnfile::String) {
+		stable_sort(entries.begin(), entries.end(),
+			[](const pair<string, streamoff>& a, const pair<string, streamoff>& b) {
+				return a.first < b.first;
+			});
+	}
+	tree.bulkload(entries);
+
+	// stamped last, so a build that didn't finish is never trusted
+	tree.setStamp(table.length(), table.modTime(), checksum, type);
+	if (!tree.flush()) {
+		cout << "**Error: couldn't write index file '" << filename << "'." << endl;
+	}
+
+}
+
+
+dbtable::dbtable() {
+
+	RecordSize = 0;
+	NumColumns = 0;
+	BtreeCachePages = 1024;
+	NumDeleted = 0;
+	Dirty = false;
+	Stopping = false;
+
+}
+
+
+// stops the maintenance thread, and saves the indexes if they have
+// changed since it last did.
+dbtable::~dbtable() {
+
+	if (Maintenance.joinable()) {
+		{
+			lock_guard<mutex> wake(WakeLock);
+			Stopping = true;
+		}
+		Wake.notify_one();
+		Maintenance.join();
+	}
+	lock_guard<mutex> writer(WriteLock);
+	if (Dirty) {
+		_settle();
+	}
+
+}
+
+
+// reads "tablename.meta" and maps "tablename.data".  Indexes are not
+// built until buildIndexes is called.  Returns false if either file
+// couldn't be read.
+bool dbtable::open(string tablename) {
+
+	Name = tablename;
+
+	// create vector with .meta data
+	vector<string> metaVector = createMetaVector(tablename);
+	if (metaVector.size() < 2) {
+		return false;
+	}
+	RecordSize = stoi(metaVector[0]); // hold offset from .meta
+	NumColumns = stoi(metaVector[1]); // hold number of columns from .meta
+
+	// loop though meta data and if column is followed by 1, then it is indexed
+	// by an avl tree, if followed by btree, by a B+tree on disk, if followed
+	// by hash, by a hash table; if, column is followed by 0, then it is not-indexed
+	// a column may declare its type as name:int, name:double or name:string
+	// (the default); types are used by the typed .col file import.exe makes
+	for (unsigned i = 2; i + 1 < metaVector.size(); i = i + 2) {
+
+		string key = metaVector[i]; // hold column
+		string isIndex = metaVector[i+1]; // hold 0, 1, btree or hash
+		int type = columnfile::String;
+		size_t colon = key.find(':');
+		if (colon != string::npos) {
+			type = ColumnType(string_view(key).substr(colon + 1));
+			if (type < 0) {
+				cout << "**Error: unknown type for column '" << key << "' in .meta." << endl;
+				return false;
+			}
+			key = key.substr(0, colon);
+		}
+		ColumnVector.push_back(key); // create column only vector
+		ColumnTypes.push_back(type);
+		ColumnIndex.push_back(-1);
+
+		if (isIndex == "1" || isIndex == "btree" || isIndex == "hash") {
+			IndexVector.push_back(key);
+			IndexColumn.push_back(ColumnVector.size() - 1);
+			IndexKind.push_back(isIndex == "1" ? "avl" : isIndex);
+			ColumnIndex.back() = IndexVector.size() - 1;
+		}
+		else if (isIndex == "0") { // if not-indexed, append column to linearsearch vector
+			LinearVector.push_back(key);
+		}
+
+	}
+
+	// finish the writes of a run that didn't checkpoint, then map the
+	// .data file once; indexes are checked against it and queries read
+	// records straight from it.  A .data file that can't be written is
+	// still read, and its table can't be changed.
+	if (RecordSize < 3) {
+		cout << "**Error: record size in .meta is too small." << endl;
+		return false;
+	}
+	Log.open(tablename, RecordSize, cout);
+	if (!Data.open(tablename, RecordSize, NumColumns)) {
+		return false;
+	}
+	for (streamoff pos = 0; pos < Data.length(); pos += RecordSize) {
+		NumDeleted += Data.deleted(pos);
+	}
+
+	// scans use the typed .col file instead, if there is an up to date one
+	Columns.open(tablename, Data, ColumnTypes);
+	return true;
+
+}
+
+
+// sets how many threads LinearSearch splits a scan across; 1 scans
+// on the calling thread.
+void dbtable::setScanThreads(int numThreads) {
+
+	if (numThreads > 1) {
+		ScanPool.reset(new workerpool(numThreads));
+	}
+	else {
+		ScanPool.reset();
+	}
+
+}
+
+
+// for each indexed column, load the tree saved by a previous run, or if
+// the data has changed since, create new tree, populate and save it for
+// next time.  Saved trees are loaded concurrently, one thread per index.
+// The trees to rebuild are fed by one pass over the .data file, which
+// tokenizes each record once for all of them, and are then built
+// concurrently, one thread per index, so rebuilding k indexes costs one
+// read of the file rather than k.  B+trees stay in their .bt files and
+// only their page caches are in memory.  Returns the # of indexes read
+// from .idx / .bt files instead of rebuilt.
+int dbtable::buildIndexes() {
+
+	uint64_t checksum = _checksum();
+	int numIndexes = IndexVector.size();
+	if (numIndexes == 0) {
+		return 0;
+	}
+	workerpool builders(numIndexes);
+
+	AvlVector.clear();
+	for (int i = 0; i < numIndexes; i++) {
+		AvlVector.push_back(keyindex(ColumnTypes[IndexColumn[i]])); // left empty for B+tree indexes
+	}
+	BtreeVector.clear();
+	BtreeVector.resize(numIndexes);
+	vector<string> filenames(numIndexes);
+	vector<char>   loaded(numIndexes);
+	builders.parallel_for(numIndexes, [&](int i) {
+		if (IndexKind[i] == "btree") {
+			BtreeVector[i].reset(new btree());
+			filenames[i] = Name + "." + IndexVector[i] + ".bt";
+			loaded[i] = openBtree(filenames[i], Data, checksum, AvlVector[i].type(), *BtreeVector[i], BtreeCachePages);
+		}
+		else {
+			filenames[i] = Name + "." + IndexVector[i] + ".idx";
+			loaded[i] = LoadIndex(filenames[i], Data, checksum, AvlVector[i]);
+		}
+	});
+
+	// the rest are rebuilt from one pass over the data
+	vector<int> rebuild, columns;
+	for (int i = 0; i < numIndexes; i++) {
+		if (!loaded[i]) {
+			rebuild.push_back(i);
+			columns.push_back(IndexColumn[i]);
+		}
+	}
+	if (!rebuild.empty()) {
+		vector<columnpairs> pairs;
+		collectColumns(Data, columns, ScanPool.get(), pairs);
+		builders.parallel_for(rebuild.size(), [&](int r) {
+			int i = rebuild[r];
+			if (IndexKind[i] == "btree") {
+				populateBtree(pairs[r], AvlVector[i].type(), filenames[i], Data, checksum, *BtreeVector[i], BtreeCachePages);
+			}
+			else {
+				populateAvlTree(pairs[r], AvlVector[i]);
+				SaveIndex(filenames[i], Data, checksum, AvlVector[i]);
+			}
+			columnpairs().swap(pairs[r]);
+		});
+	}
+
+	// freeze each index into the read-optimized layout queries use: a
+	// hash table for hash indexes, whose trees are then freed (the first
+	// write thaws them), and a flatindex for the rest
+	Stale.assign(numIndexes, false);
+	FlatVector.clear();
+	FlatVector.resize(numIndexes);
+	HashVector.clear();
+	HashVector.resize(numIndexes);
+	builders.parallel_for(numIndexes, [&](int i) {
+		if (IndexKind[i] == "hash") {
+			AvlVector[i].visit([&](const auto& tree) {	HashVector[i].build(tree);	});
+			AvlVector[i] = keyindex(AvlVector[i].type());
+		}
+		else if (IndexKind[i] == "avl") {
+			AvlVector[i].visit([&](const auto& tree) {	FlatVector[i].freeze(tree);	});
+		}
+	});
+	return numIndexes - rebuild.size();
+
+}
+
+
+// removes the record at pos, whose values are given, from every index
+void dbtable::_unindex(streamoff pos, vector<string_view>& values) {
+
+	string key;
+	for (unsigned i = 0; i < IndexVector.size(); i++) {
+		if (IndexKind[i] != "btree") {
+			AvlVector[i].erase(values[IndexColumn[i]], pos, Data);
+			Stale[i] = true;
+		}
+		else if (IndexKey(AvlVector[i].type(), values[IndexColumn[i]], key)) {
+			BtreeVector[i]->remove(key, pos);
+		}
+	}
+
+}
+
+
+// adds the record at pos, whose values are given, to every index.
+// Records are only ever appended, so pos goes at the end of its key's
+// posting list, which stays in file order.
+void dbtable::_index(streamoff pos, vector<string_view>& values) {
+
+	string key;
+	for (unsigned i = 0; i < IndexVector.size(); i++) {
+		if (IndexKind[i] != "btree") {
+			AvlVector[i].insert(values[IndexColumn[i]], pos);
+			Stale[i] = true;
+		}
+		else if (IndexKey(AvlVector[i].type(), values[IndexColumn[i]], key)) {
+			BtreeVector[i]->insert(key, pos);
+		}
+	}
+
+}
+
+
+// deletes the records at the given positions and appends records, each
+// a formatted record of RecordSize bytes (see FormatRecord), as one
+// write: logged first, so it survives a crash whole or not at all, then
+// applied to the .data file and the indexes.  The caller must hold
+// writeLock() and have checked the positions are of live records.
+// Returns false, after writing why to errors, if nothing was written,
+// or if the logged write couldn't be applied to the .data file even by
+// replaying the log; the table is then read-only, and the next open
+// replays it.
+bool dbtable::write(const vector<streamoff>& deletes, const vector<string>& records, ostream& errors) {
+
+	if (!Log.isOpen()) {
+		errors << "**Error: table '" << Name << "' is read-only." << endl;
+		return false;
+	}
+	streamoff end = Data.length();
+	if (!Log.write(deletes, records, end)) {
+		errors << "**Error: couldn't write to table '" << Name << "'." << endl;
+		return false;
+	}
+
+	// logged; now applied, while no query is reading the records
+	unique_lock<shared_mutex> exclusive(Lock);
+	if (!Dirty) {
+		// the saved B+trees are about to change; until they are stamped
+		// again, a crash leaves them to be rebuilt rather than trusted
+		for (unsigned i = 0; i < IndexVector.size(); i++) {
+			if (IndexKind[i] == "btree") {
+				BtreeVector[i]->setStamp(0, 0, 0);
+				BtreeVector[i]->flush();
+			}
+			else if (IndexKind[i] == "hash" && !Stale[i] && AvlVector[i].size() == 0) {
+				AvlVector[i].thaw(HashVector[i], Data);
+			}
+		}
+	}
+	Columns.close(); // scans of the .data file see the new records, the .col file doesn't
+
+	vector<string_view> values;
+	for (streamoff pos : deletes) {
+		GetRecord(Data, pos, values); // before the tombstone, which may overwrite the space after the last value
+		_unindex(pos, values);
+		StaleBlocks.push_back((pos + RecordSize - 3) / ChecksumBlock);
+	}
+	const char* mapping = Data.data();
+	if (!Log.apply(deletes, records, end) && !Log.replay(errors)) {
+		// the .data file has some of the write, and the log all of it,
+		// for the next open to replay.  Its appended records aren't
+		// indexed, as they may not all be there; the table is read-only.
+		Data.refresh();
+		errors << "**Error: couldn't write to table '" << Name << "'; it is read-only until reopened." << endl;
+		return false;
+	}
+	NumDeleted += deletes.size();
+	Data.refresh();
+	if (Data.data() != mapping) { // the file outgrew its mapping, which moved
+		for (keyindex& index : AvlVector) {
+			index.rebase(mapping, Data.data(), [](streamoff pos) {	return pos;	});
+		}
+	}
+	for (size_t r = 0; r < records.size(); r++) {
+		streamoff pos = end + (streamoff) r * RecordSize;
+		GetRecord(Data, pos, values);
+		_index(pos, values);
+	}
+
+	Dirty = true;
+	LastWrite = chrono::steady_clock::now();
+	if (!Maintenance.joinable()) {
+		Maintenance = thread(&dbtable::_maintain, this);
+	}
+	return true;
+
+}
+
+
+// the maintenance thread: checks every 100ms whether writes have paused
+// for that long, and if so settles or compacts the table.
+void dbtable::_maintain() {
+
+	const chrono::milliseconds Quiet(100);
+	unique_lock<mutex> wake(WakeLock);
+	while (!Stopping) {
+		Wake.wait_for(wake, Quiet);
+		if (Stopping) {
+			break;
+		}
+		wake.unlock();
+		{
+			lock_guard<mutex> writer(WriteLock);
+			if (Dirty && chrono::steady_clock::now() - LastWrite >= Quiet) {
+				int64_t numRecords = Data.length() / RecordSize;
+				if (NumDeleted == 0 || NumDeleted * 4 < numRecords || !_compact()) {
+					_settle();
+				}
+			}
+		}
+		wake.lock();
+	}
+
+}
+
+
+// brings the table's files up to date with its writes: refreezes the
+// stale snapshots, checkpoints the log, and saves the indexes stamped
+// with the current .data file.  The new snapshots are built while
+// queries go on, and only swapped in under the exclusive lock.  Called
+// with WriteLock held.
+void dbtable::_settle() {
+
+	int numIndexes = IndexVector.size();
+	vector<flatindex> flat(numIndexes);
+	vector<hashindex> hash(numIndexes);
+	for (int i = 0; i < numIndexes; i++) {
+		if (Stale[i] && IndexKind[i] == "hash") {
+			AvlVector[i].visit([&](const auto& tree) {	hash[i].build(tree);	});
+		}
+		else if (Stale[i] && IndexKind[i] == "avl") {
+			AvlVector[i].visit([&](const auto& tree) {	flat[i].freeze(tree);	});
+		}
+	}
+	{
+		unique_lock<shared_mutex> exclusive(Lock);
+		for (int i = 0; i < numIndexes; i++) {
+			if (Stale[i]) {
+				swap(FlatVector[i], flat[i]);
+				swap(HashVector[i], hash[i]);
+				Stale[i] = false;
+			}
+		}
+	}
+
+	Log.checkpoint();
+	uint64_t checksum = _checksum();
+	bool saved = true;
+	for (int i = 0; i < numIndexes; i++) {
+		if (IndexKind[i] == "btree") {
+			BtreeVector[i]->setStamp(Data.length(), Data.modTime(), checksum, AvlVector[i].type());
+			saved &= BtreeVector[i]->flush();
+		}
+		else {
+			SaveIndex(Name + "." + IndexVector[i] + ".idx", Data, checksum, AvlVector[i]);
+		}
+	}
+	Dirty = !saved; // a B+tree that couldn't be written is tried again at the next settle
+
+}
+
+
+// the .data file's Checksum.  The first call hashes every block, on the
+// scan pool; later ones only hash again the blocks written in place
+// since, and those appended records reached.  Called by buildIndexes,
+// and with WriteLock held.
+uint64_t dbtable::_checksum() {
+
+	size_t numBlocks = (Data.length() + ChecksumBlock - 1) / ChecksumBlock;
+	vector<size_t> blocks;
+	if (BlockHashes.empty()) {
+		blocks.resize(numBlocks);
+		iota(blocks.begin(), blocks.end(), 0);
+	}
+	else {
+		blocks.swap(StaleBlocks);
+		for (size_t block = BlockHashes.size() - 1; block < numBlocks; block++) { // the old last block may have grown
+			blocks.push_back(block);
+		}
+		sort(blocks.begin(), blocks.end());
+		blocks.erase(unique(blocks.begin(), blocks.end()), blocks.end());
+		while (!blocks.empty() && blocks.back() >= numBlocks) {
+			blocks.pop_back();
+		}
+	}
+	BlockHashes.resize(numBlocks);
+	StaleBlocks.clear();
+	BlockChecksums(Data, blocks, BlockHashes, ScanPool.get());
+	return Checksum(Data, BlockHashes);
+
+}
+
+
+// rewrites the .data file without its deleted records, as
+// "tablename.data.tmp" renamed over it, and moves every index's
+// positions to where their records went.  The copy is made while
+// queries go on; only the rename and the moves hold the exclusive lock.
+// Then settles.  Called with WriteLock held.  Returns false, leaving
+// the table as it was, if the copy couldn't be written.
+bool dbtable::_compact() {
+
+	string filename = Name + ".data";
+	string tempname = filename + ".tmp";
+	int out = ::open(tempname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (out < 0) {
+		return false;
+	}
+
+	// deletedBefore[r]: # of deleted records before record r, which is
+	// how many records r moves back
+	int64_t numRecords = (Data.length() + RecordSize - 1) / RecordSize;
+	vector<int64_t> deletedBefore(numRecords + 1, 0);
+	const size_t BlockSize = 1 << 20;
+	string block;
+	bool ok = true;
+	off_t written = 0;
+	for (int64_t r = 0; r < numRecords && ok; r++) {
+		streamoff pos = r * RecordSize;
+		bool deleted = Data.deleted(pos);
+		deletedBefore[r + 1] = deletedBefore[r] + deleted;
+		if (!deleted) {
+			block.append(Data.data() + pos, min((streamoff) RecordSize, Data.length() - pos));
+		}
+		if (block.size() >= BlockSize || (r + 1 == numRecords && !block.empty())) {
+			ok = pwrite(out, block.data(), block.size(), written) == (ssize_t) block.size();
+			written += block.size();
+			block.clear();
+		}
+	}
+	ok = ok && fsync(out) == 0;
+	::close(out);
+	if (!ok) {
+		remove(tempname.c_str());
+		return false;
+	}
+
+	{
+		unique_lock<shared_mutex> exclusive(Lock);
+		Log.checkpoint();
+		if (rename(tempname.c_str(), filename.c_str()) != 0) {
+			remove(tempname.c_str());
+			return false;
+		}
+		const char* mapping = Data.data();
+		Data.refresh(true);
+		Log.close(); // its descriptor is of the old file
+		Log.open(Name, RecordSize, cout);
+
+		int rs = RecordSize;
+		auto moved = [&](streamoff pos) {	return pos - rs * deletedBefore[pos / rs];	};
+		for (unsigned i = 0; i < IndexVector.size(); i++) {
+			if (IndexKind[i] == "btree") {
+				BtreeVector[i]->remap(moved);
+				continue;
+			}
+			AvlVector[i].visit([&](auto& tree) {
+				tree.transform_values([&](postinglist& postings) {
+					for (streamoff& pos : postings) {
+						pos = moved(pos);
+					}
+				});
+			});
+			AvlVector[i].rebase(mapping, Data.data(), moved);
+			FlatVector[i].remap(moved);
+			HashVector[i].remap(moved);
+		}
+		Cache.clear();
+		NumDeleted = 0;
+		BlockHashes.clear(); // every block has moved
+	}
+	_settle();
+	return true;
+
+}
@@ -0,0 +1,136 @@
+#ifndef TABLE_H
+#define TABLE_H
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include "avl.h"
+#include "util.h"
+#include "hashindex.h"
+#include "recordcache.h"
+#include "writelog.h"
+using namespace std;
+
+
+// A table and everything built for it at startup: the column names
+// from .meta, the mapped .data file, and one index per indexed column
+// --- an in-memory avl tree (flag 1 in .meta), a disk-resident B+tree
+// (flag btree), for columns whose index shouldn't live in memory, or a
+// hash table (flag hash), for columns only ever looked up with =.  An
+// index on an int or double column keys its records by number (see
+// keyindex).  The table owns its indexes; queries only borrow them
+// through const references, so nothing is copied per query.
+//
+// write() inserts and deletes records: appended to .data, or tombstoned
+// in it, through the table's writelog, and then applied to every index
+// --- the avl trees and B+trees in place, while the frozen flatindex and
+// hash table snapshots are marked stale, and queries search the avl tree
+// behind a stale snapshot instead.  Queries hold lock() shared; write()
+// holds it exclusively once the write is logged and synced.  A shared
+// lock still writes the lock's state, so concurrent queries contend for
+// its cache line even though none waits for another.  Writers
+// hold writeLock() from finding their records until write() returns.
+// A maintenance thread, started by the first write, settles the table
+// once writes pause: it refreezes stale snapshots, checkpoints the log,
+// and saves the indexes for the next run.  Once a quarter of the
+// records are deleted it compacts the .data file instead, copying out
+// the live records and moving every index's positions to match.
+class dbtable {
+
+private:
+
+	string Name;        // table name, e.g. "students"
+	int    RecordSize;  // fixed size of one record, from .meta
+	int    NumColumns;  // # of values per record, from .meta
+
+	vector<string> ColumnVector;  // holds all columns
+	vector<int>    ColumnTypes;   // type of each column (columnfile::String, Int, Double)
+	vector<string> LinearVector;  // holds non-indexed columns
+	vector<string> IndexVector;   // holds indexed columns
+	vector<int>    IndexColumn;   // for each index, which column it is (0-based)
+	vector<int>    ColumnIndex;   // for each column, its index # (-1 if not indexed)
+	vector<keyindex> AvlVector;  // holds avl trees for indexed columns, keyed by the column's type
+	vector<flatindex> FlatVector; // frozen copy of each avl tree, what queries search
+	vector<string> IndexKind;     // for each index, "avl", "btree" or "hash"
+	vector<unique_ptr<btree>> BtreeVector; // B+tree of each btree index (null for others)
+	vector<hashindex> HashVector; // hash table of each hash index (empty for others)
+	size_t BtreeCachePages;       // page cache size of each B+tree
+
+	datafile Data;  // the mapped .data file
+	columnfile Columns;  // the mapped .col file, if import.exe made one for this .data file
+	mutable recordcache Cache;  // parsed records recently read by queries
+	unique_ptr<workerpool> ScanPool;  // threads for scanning unindexed columns (null: scan serially)
+
+	writelog Log;          // writes to the .data file
+	mutable shared_mutex Lock;  // shared by queries, exclusive while the table changes
+	mutex    WriteLock;    // held by a writer, and by maintenance
+	vector<char> Stale;    // for each index, whether its flatindex / hash table snapshot is out of date
+	int64_t  NumDeleted;   // # of tombstoned records in the .data file
+	bool     Dirty;        // written since the indexes were last saved
+	vector<uint64_t> BlockHashes;  // hash of each block of the .data file (see Checksum); empty: not made yet
+	vector<size_t>   StaleBlocks;  // blocks written in place (tombstoned) since their hash was made
+	chrono::steady_clock::time_point LastWrite;
+	thread   Maintenance;
+	mutex    WakeLock;
+	condition_variable Wake;
+	bool     Stopping;     // tells Maintenance to finish
+
+	void _unindex(streamoff pos, vector<string_view>& values);
+	void _index(streamoff pos, vector<string_view>& values);
+	void _maintain();
+	void _settle();
+	bool _compact();
+	uint64_t _checksum();
+
+public:
+
+	dbtable();
+	dbtable(const dbtable& other) = delete;
+	dbtable& operator=(const dbtable& other) = delete;
+	~dbtable();
+
+	bool open(string tablename);
+	int  buildIndexes();
+	bool write(const vector<streamoff>& deletes, const vector<string>& records, ostream& errors);
+	void setScanThreads(int numThreads);
+	void setSyncWrites(bool sync)          {	Log.setSync(sync);	}
+	void setBtreeCache(size_t cachePages)  {	BtreeCachePages = cachePages;	}
+	void setRecordCache(size_t records)    {	Cache.reset(records, NumColumns);	}
+
+	// GetRecord on the table's .data file, through its record cache
+	void getRecord(streamoff pos, vector<string_view>& values) const  {	Cache.get(Data, pos, values);	}
+
+	const string& name() const  {	return Name;	}
+	int recordSize() const      {	return RecordSize;	}
+	int numColumns() const      {	return NumColumns;	}
+	const datafile& data() const  {	return Data;	}
+	const columnfile& columns() const  {	return Columns;	}
+	workerpool* scanPool() const  {	return ScanPool.get();	}
+	const recordcache& recordCache() const  {	return Cache;	}
+
+	const vector<string>& columnVector() const  {	return ColumnVector;	}
+	const vector<int>& columnTypes() const      {	return ColumnTypes;	}
+	const vector<string>& linearVector() const  {	return LinearVector;	}
+	const vector<string>& indexVector() const   {	return IndexVector;	}
+	const vector<keyindex>& avlVector() const  {	return AvlVector;	}
+	const vector<flatindex>& flatVector() const  {	return FlatVector;	}
+	const vector<hashindex>& hashVector() const  {	return HashVector;	}
+	const string& indexKind(int index) const  {	return IndexKind[index];	}
+	int indexColumn(int index) const  {	return IndexColumn[index];	}
+	int columnIndex(int column) const {	return ColumnIndex[column];	}
+	const btree& btreeIndex(int index) const  {	return *BtreeVector[index];	}
+	bool indexStale(int index) const  {	return Stale[index];	}
+	int64_t numDeleted() const        {	return NumDeleted;	}
+
+	shared_mutex& lock() const  {	return Lock;	}
+	mutex& writeLock()          {	return WriteLock;	}
+
+};
+
+#endif
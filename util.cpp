@@ -3,8 +3,20 @@
 #include <vector>
 #include <string>
 #include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>  // rename, remove
+#include <algorithm>
+#include <numeric>
+#include <charconv>
+#if defined(__SSE2__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
 #include "util.h"
 #include "avl.h"
+#include "stats.h"
 using namespace std;
 
 
@@ -121,4 +133,1384 @@ vector<streamoff> LinearSearch(string tablename, int recordSize, int numColumns,
 
 	return matches;
 
-}
\ No newline at end of file
+}
+
+
+// field separators in a .data file; the same characters >> skips.
+static inline bool isSeparator(char c) {
+
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+
+}
+
+
+// reads the next whitespace-delimited value starting at data[pos],
+// without going past data[end].  pos is advanced past the value.
+static inline string_view nextValue(const char* data, streamoff& pos, streamoff end) {
+
+	while (pos < end && isSeparator(data[pos])) {
+		pos++;
+	}
+	streamoff start = pos;
+	while (pos < end && !isSeparator(data[pos])) {
+		pos++;
+	}
+	return string_view(data + start, pos - start);
+
+}
+
+
+// separator bitmask of the 32 bytes at p: bit i is set if p[i] is a
+// separator.  Bits at or past n (the bytes left before the end of the
+// record) are set too, so a field never runs off the end.  Uses AVX2 or
+// SSE2 byte compares when the compiler targets them; near the end of
+// the mapping, where a 32 byte load could run off the last page, and on
+// other targets it falls back to a byte loop.
+static inline uint32_t separatorMask(const char* p, streamoff n) {
+
+#if defined(__AVX2__)
+	if (n >= 32) {
+		__m256i bytes = _mm256_loadu_si256((const __m256i*) p);
+		__m256i sep = _mm256_or_si256(
+			_mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\t'))),
+			_mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\r')), _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\n'))));
+		return (uint32_t) _mm256_movemask_epi8(sep);
+	}
+#elif defined(__SSE2__)
+	if (n >= 32) {
+		uint32_t mask = 0;
+		for (int half = 0; half < 2; half++) {
+			__m128i bytes = _mm_loadu_si128((const __m128i*) (p + 16 * half));
+			__m128i sep = _mm_or_si128(
+				_mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\t'))),
+				_mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('\r')), _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\n'))));
+			mask |= (uint32_t) _mm_movemask_epi8(sep) << (16 * half);
+		}
+		return mask;
+	}
+#endif
+	uint32_t mask = 0;
+	for (int i = 0; i < 32; i++) {
+		if (i >= n || isSeparator(p[i])) {
+			mask |= 1u << i;
+		}
+	}
+	return mask;
+
+}
+
+
+// returns the value in column (0-based) of the record in data[pos, end),
+// found 32 bytes at a time from separator bitmasks rather than byte by
+// byte: a value starts at each non-separator whose previous byte is a
+// separator, so whole blocks of values are skipped with one popcount.
+// Returns an empty view if the record has fewer values.
+string_view FieldAt(const char* data, streamoff pos, streamoff end, int column) {
+
+	uint32_t  carry = 1;       // the byte before the record counts as a separator
+	int       skip = column;   // # of value starts still to pass
+	streamoff fieldStart = -1;
+
+	for (streamoff off = pos; off < end; off += 32) {
+
+		uint32_t sep = separatorMask(data + off, end - off);
+		if (fieldStart < 0) { // still looking for the start of the value
+			uint32_t starts = ~sep & ((sep << 1) | carry);
+			int count = __builtin_popcount(starts);
+			if (count <= skip) {
+				skip -= count;
+				carry = sep >> 31;
+				continue;
+			}
+			for (; skip > 0; skip--) { // drop the starts of earlier values
+				starts &= starts - 1;
+			}
+			int bit = __builtin_ctz(starts);
+			fieldStart = off + bit;
+			sep &= ~0u << bit;  // only separators after the start end the value
+		}
+		if (sep != 0) {
+			return string_view(data + fieldStart, off + __builtin_ctz(sep) - fieldStart);
+		}
+		carry = 0;
+
+	}
+
+	if (fieldStart < 0) {
+		return string_view();
+	}
+	return string_view(data + fieldStart, end - fieldStart);
+
+}
+
+
+datafile::datafile() {
+
+	Data = nullptr;
+	Length = 0;
+	Mapped = 0;
+	ModTime = 0;
+	RecordSize = 0;
+	NumColumns = 0;
+
+}
+
+
+datafile::~datafile() {
+
+	close();
+
+}
+
+
+// maps "tablename.data" into memory.  Returns false (and outputs an
+// error) if the file can't be opened or mapped.
+bool datafile::open(string tablename, int recordSize, int numColumns) {
+
+	close();
+	RecordSize = recordSize;
+	NumColumns = numColumns;
+	FileName = tablename + ".data";
+	return refresh();
+
+}
+
+
+// maps the open file fd, whose length is Length, with room to grow: a
+// quarter more than its length, at least 1MB.  Pages past the end of the
+// file are never read, since every read stops at Length.
+bool datafile::_map(int fd) {
+
+	if (Data != nullptr) {
+		munmap((void*) Data, Mapped);
+		Data = nullptr;
+		Mapped = 0;
+	}
+	if (Length == 0) { // mmap of an empty file fails, nothing to map anyway
+		return true;
+	}
+	size_t size = Length + max((size_t) Length / 4, (size_t) 1 << 20);
+	void* mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+	if (mapping == MAP_FAILED) {
+		cout << "**Error: couldn't map data file '" << FileName << "'." << endl;
+		Length = 0;
+		return false;
+	}
+	Data = (const char*) mapping;
+	Mapped = size;
+	return true;
+
+}
+
+
+// re-reads the file's length and modification time, after it has been
+// written to, and maps it again if it has outgrown the mapping (or was
+// replaced by a new file, when reopen is true); views into the old
+// mapping are then no longer valid.  Returns false (and outputs an
+// error) if the file can't be opened or mapped.
+bool datafile::refresh(bool reopen) {
+
+	int fd = ::open(FileName.c_str(), O_RDONLY);
+	struct stat info;
+	if (fd < 0 || fstat(fd, &info) != 0) {
+		cout << "**Error: couldn't open data file '" << FileName << "'." << endl;
+		if (fd >= 0) {
+			::close(fd);
+		}
+		return false;
+	}
+
+	Length = info.st_size;
+	ModTime = info.st_mtime;
+	bool ok = true;
+	if (reopen || Data == nullptr || (size_t) Length > Mapped) {
+		ok = _map(fd);
+	}
+	::close(fd); // the mapping stays valid after the descriptor is closed
+	return ok;
+
+}
+
+
+// unmaps the file; safe to call more than once.
+void datafile::close() {
+
+	if (Data != nullptr) {
+		munmap((void*) Data, Mapped);
+	}
+	Data = nullptr;
+	Length = 0;
+	Mapped = 0;
+
+}
+
+
+// same as EchoData above, but reads from an already mapped table.
+void EchoData(const datafile& table) {
+
+	streamoff pos = 0;  // first record at offset 0:
+	while (pos < table.length()) {
+
+		streamoff cur = pos;
+		if (table.deleted(pos)) {
+			pos += table.recordSize();
+			continue;
+		}
+		for (int i = 0; i < table.numColumns(); ++i) { // read values, one per column
+			cout << nextValue(table.data(), cur, table.length()) << " ";
+		}
+		cout << endl;
+		pos += table.recordSize();  // move offset to start of next record:
+
+	}
+
+}
+
+
+// same as GetRecord above, but reads from an already mapped table and
+// fills values with views into the mapping.  values is cleared first;
+// reuse the same vector across calls and no memory is allocated.
+void GetRecord(const datafile& table, streamoff pos, vector<string_view>& values) {
+
+	values.clear();
+	for (int i = 0; i < table.numColumns(); i++) {
+		values.push_back(nextValue(table.data(), pos, table.length()));
+	}
+
+}
+
+
+// the inverse of GetRecord: lays values out as a record of recordSize
+// bytes, the way the .data files are written --- each value followed by
+// a space, padded with '.' and ended by \r\n.  Returns false if the
+// values don't fit, or one of them is empty or has a separator in it.
+bool FormatRecord(const vector<string>& values, int recordSize, string& record) {
+
+	record.clear();
+	for (const string& value : values) {
+		if (value.empty() || any_of(value.begin(), value.end(), isSeparator)) {
+			return false;
+		}
+		record += value;
+		record += ' ';
+	}
+	if ((int) record.size() > recordSize - 2) {
+		return false;
+	}
+	record.resize(recordSize - 2, '.');
+	record += "\r\n";
+	return true;
+
+}
+
+
+// same as LinearSearch above, but scans an already mapped table.
+vector<streamoff> LinearSearch(const datafile& table, string_view matchValue, int matchColumn) {
+
+	vector<streamoff>  matches;
+	streamoff pos = 0;  // first record at offset 0:
+	if (table.recordSize() > 0) {
+		CountStat(&querystats::RecordsScanned, (table.length() + table.recordSize() - 1) / table.recordSize());
+		CountStat(&querystats::BytesRead, table.length());
+	}
+
+	while (pos < table.length()) {
+
+		streamoff end = min(pos + table.recordSize(), table.length());
+		string_view value = FieldAt(table.data(), pos, end, matchColumn - 1);
+		if (value == matchValue && !table.deleted(pos)) {
+			matches.push_back(pos);
+		}
+		pos += table.recordSize();  // move offset to start of next record:
+
+	}
+
+	return matches;
+
+}
+
+
+
+// the prefix a like pattern matches: "abc%" -> "abc".  A pattern
+// without a trailing % matches exactly, the same as =.
+static string_view likePrefix(const predicate& where) {
+
+	string_view pattern = where.Value;
+	if (!pattern.empty() && pattern.back() == '%') {
+		pattern.remove_suffix(1);
+	}
+	return pattern;
+
+}
+
+
+// compares value to the clause's bound(s), low and high, in T's order
+template<typename T>
+static bool compareValue(const string& op, const T& value, const T& low, const T& high) {
+
+	if (op == "=") {
+		return value == low;
+	}
+	else if (op == "<") {
+		return value < low;
+	}
+	else if (op == "<=") {
+		return value <= low;
+	}
+	else if (op == ">") {
+		return value > low;
+	}
+	else if (op == ">=") {
+		return value >= low;
+	}
+	else if (op == "between") {
+		return value >= low && value <= high;
+	}
+	return false;
+
+}
+
+
+// sets the type of the column the clause is on, and parses its values
+// as that type --- Valid is false if they aren't --- and as index keys.
+// like always compares text, so its value is left as it is.
+void predicate::prepare(int type) {
+
+	Type = type;
+	Valid = true;
+	bool between = (Op == "between");
+	if (Op == "like" || type == columnfile::String) {
+		Key = Value;
+		Key2 = Value2;
+	}
+	else if (type == columnfile::Int) {
+		Valid = ParseKey(Value, IntValue) && (!between || ParseKey(Value2, IntValue2));
+		Key = EncodeKey(IntValue);
+		Key2 = EncodeKey(IntValue2);
+	}
+	else if (type == columnfile::Double) {
+		Valid = ParseKey(Value, DoubleValue) && (!between || ParseKey(Value2, DoubleValue2));
+		Key = EncodeKey(DoubleValue);
+		Key2 = EncodeKey(DoubleValue2);
+	}
+
+}
+
+
+// returns true if value satisfies the where clause.
+bool predicate::matches(string_view value) const {
+
+	if (Op == "like") {
+		string_view prefix = likePrefix(*this);
+		if (prefix.size() == Value.size()) { // no %, exact match
+			return value == prefix;
+		}
+		return value.substr(0, prefix.size()) == prefix;
+	}
+	else if (!Valid) {
+		return false;
+	}
+	else if (Type == columnfile::Int) {
+		int64_t number;
+		return ParseKey(value, number) && compareValue(Op, number, IntValue, IntValue2);
+	}
+	else if (Type == columnfile::Double) {
+		double number;
+		return ParseKey(value, number) && compareValue(Op, number, DoubleValue, DoubleValue2);
+	}
+	return compareValue(Op, value, string_view(Value), string_view(Value2));
+
+}
+
+
+// scans the records starting in [first, last) of the file and adds
+// the positions of the ones test(pos, end) is true for --- given the
+// record's bytes, [pos, end) --- to matches.  Deleted records never
+// match.
+template<typename Test>
+static void scanRange(const datafile& table, const Test& test, streamoff first, streamoff last,
+			vector<streamoff>& matches) {
+
+	streamoff pos = first;
+	while (pos < last) {
+
+		streamoff end = min(pos + table.recordSize(), table.length());
+		if (test(pos, end) && !table.deleted(pos)) {
+			matches.push_back(pos);
+		}
+		pos += table.recordSize();  // move offset to start of next record:
+
+	}
+
+}
+
+
+// scanRange over the whole file.  Given a worker pool, the file is split
+// into record-aligned chunks that are scanned in parallel; each chunk's
+// matches are kept separately and appended in chunk order, so positions
+// still come back in file order.  Tables too small to be worth
+// splitting are scanned on this thread.
+template<typename Test>
+static vector<streamoff> scanChunks(const datafile& table, const Test& test, workerpool* pool) {
+
+	vector<streamoff>  matches;
+	if (table.recordSize() <= 0) {
+		return matches;
+	}
+
+	const streamoff MinChunkRecords = 4096;  // smaller chunks cost more to hand off than to scan
+	streamoff numRecords = (table.length() + table.recordSize() - 1) / table.recordSize();
+	CountStat(&querystats::RecordsScanned, numRecords);
+	CountStat(&querystats::BytesRead, table.length());
+	streamoff numChunks = 1;
+	if (pool != nullptr && pool->size() > 1) {
+		numChunks = min((streamoff) pool->size() * 4, numRecords / MinChunkRecords);
+	}
+	if (numChunks <= 1) {
+		scanRange(table, test, 0, table.length(), matches);
+		return matches;
+	}
+
+	vector<vector<streamoff>> chunkMatches(numChunks);
+	streamoff recordsPerChunk = (numRecords + numChunks - 1) / numChunks;
+	pool->parallel_for(numChunks, [&](int chunk) {
+		streamoff first = chunk * recordsPerChunk * table.recordSize();
+		streamoff last = min(first + recordsPerChunk * table.recordSize(), table.length());
+		scanRange(table, test, first, last, chunkMatches[chunk]);
+	});
+
+	for (const vector<streamoff>& found : chunkMatches) {
+		matches.insert(matches.end(), found.begin(), found.end());
+	}
+	return matches;
+
+}
+
+
+// same as LinearSearch above, but matches records whose column
+// satisfies a where clause rather than equals one value, and can scan
+// in parallel (see scanChunks)
+vector<streamoff> LinearSearch(const datafile& table, const predicate& where, int matchColumn, workerpool* pool) {
+
+	return scanChunks(table, [&](streamoff pos, streamoff end) {
+		return where.matches(FieldAt(table.data(), pos, end, matchColumn - 1));
+	}, pool);
+
+}
+
+
+// same again, for tests of more than one column: matches the records
+// test(pos, end) is true for, in one pass over the file
+vector<streamoff> LinearSearch(const datafile& table, const function<bool(streamoff, streamoff)>& test, workerpool* pool) {
+
+	return scanChunks(table, test, pool);
+
+}
+
+
+keyindex::keyindex(int type) {
+
+	if (type == columnfile::Int) {
+		Tree.emplace<columnfile::Int>();
+	}
+	else if (type == columnfile::Double) {
+		Tree.emplace<columnfile::Double>();
+	}
+
+}
+
+
+// adds pos to the posting list of value's key.  Records are only ever
+// appended, so pos goes at the end, and the list stays in file order.
+bool keyindex::insert(string_view value, streamoff pos) {
+
+	return visit([&](auto& tree) {
+		typename remove_reference<decltype(tree)>::type::key_type key;
+		if (!ParseKey(value, key)) {
+			return false;
+		}
+		tree.emplace(key)->push_back(pos);
+		return true;
+	});
+
+}
+
+
+// the copy of bytes in the record at pos, as a key.  False if the
+// record doesn't hold them.
+static bool recordKey(const datafile& data, streamoff pos, string_view bytes, fieldkey& key) {
+
+	if (pos < 0 || pos >= data.length()) {
+		return false;
+	}
+	string_view record(data.data() + pos, min((streamoff) data.recordSize(), data.length() - pos));
+	size_t at = record.find(bytes);
+	if (at == string_view::npos) {
+		return false;
+	}
+	key = fieldkey(record.substr(at, bytes.size()));
+	return true;
+
+}
+
+
+// removes pos from the posting list of value's key, and the key once
+// its list is empty.  Returns false if pos wasn't there.  A fieldkey
+// that views the record at pos, which is about to be deleted, is moved
+// to the first record left in its list.
+bool keyindex::erase(string_view value, streamoff pos, const datafile& data) {
+
+	return visit([&](auto& tree) {
+		typedef typename remove_reference<decltype(tree)>::type::key_type TKey;
+		TKey key;
+		if (!ParseKey(value, key)) {
+			return false;
+		}
+		postinglist* postings = tree.search(key);
+		if (postings == nullptr || !postings->erase(pos)) {
+			return false;
+		}
+		if (postings->empty()) {
+			tree.remove(key);
+		}
+		else if constexpr (is_same<TKey, fieldkey>::value) {
+			const char* bytes = tree.lower_bound(key).key().data();
+			if (bytes >= data.data() + pos && bytes < data.data() + pos + data.recordSize()) {
+				postinglist kept = std::move(*postings);
+				fieldkey moved;
+				recordKey(data, *kept.begin(), value, moved);
+				tree.remove(key);
+				tree.insert(moved, std::move(kept));
+			}
+		}
+		return true;
+	});
+
+}
+
+
+// rebuilds the tree from the hash table it was frozen into.  fieldkeys
+// view the first record of their lists.
+void keyindex::thaw(const hashindex& hash, const datafile& data) {
+
+	visit([&](auto& tree) {
+		typedef typename remove_reference<decltype(tree)>::type::key_type TKey;
+		hash.thaw(tree, [&](string_view bytes, positionrange positions) {
+			TKey key;
+			if constexpr (is_same<TKey, fieldkey>::value) {
+				recordKey(data, *positions.begin(), bytes, key);
+			}
+			else {
+				DecodeKey(bytes, key);
+			}
+			return key;
+		});
+	});
+
+}
+
+
+// moves every fieldkey's view after the .data file's mapping moves from
+// from to to, and the records in it from position p to moved(p).
+void keyindex::rebase(const char* from, const char* to, const function<streamoff(streamoff)>& moved) {
+
+	if (Tree.index() != columnfile::String) {
+		return;
+	}
+	get<columnfile::String>(Tree).transform_keys([&](fieldkey& key) {
+		key.rebase(to + moved(key.data() - from));
+	});
+
+}
+
+
+// the key a B+tree on a column of the given type keeps value under: the
+// value parsed and encoded by EncodeKey, so the tree's byte order is the
+// type's order.  Returns false if value isn't of the type.
+bool IndexKey(int type, string_view value, string& key) {
+
+	if (type == columnfile::Int) {
+		int64_t number;
+		if (!ParseKey(value, number)) {
+			return false;
+		}
+		key = EncodeKey(number);
+	}
+	else if (type == columnfile::Double) {
+		double number;
+		if (!ParseKey(value, number)) {
+			return false;
+		}
+		key = EncodeKey(number);
+	}
+	else {
+		key.assign(value.data(), value.size());
+	}
+	return true;
+
+}
+
+
+// the clause's bounds as keys of an index's type
+static void keyBounds(const predicate& where, fieldkey& low, fieldkey& high) {
+
+	low = fieldkey(where.Value);
+	high = fieldkey(where.Value2);
+
+}
+
+static void keyBounds(const predicate& where, int64_t& low, int64_t& high) {
+
+	low = where.IntValue;
+	high = where.IntValue2;
+
+}
+
+static void keyBounds(const predicate& where, double& low, double& high) {
+
+	low = where.DoubleValue;
+	high = where.DoubleValue2;
+
+}
+
+
+// answers a where clause from an index alone: walks the keys in
+// [first, last) and returns the positions of their records, in key
+// order (and file order within a key).  No records are read.  Only a
+// string index can answer like; queries scan for like on a number.
+template<typename TKey>
+static vector<streamoff> avlSearch(const avltree<TKey, postinglist>& tree, const predicate& where) {
+
+	vector<streamoff>  matches;
+	typename avltree<TKey, postinglist>::iterator first, last;
+	if (!where.Valid) {
+		return matches;
+	}
+	TKey low, high;
+	keyBounds(where, low, high);
+
+	if (where.Op == "=") {
+		const postinglist* postings = tree.search(low);
+		if (postings != nullptr) {
+			matches.assign(postings->begin(), postings->end());
+		}
+		return matches;
+	}
+	else if (where.Op == "<") {
+		first = tree.begin();
+		last = tree.lower_bound(low);
+	}
+	else if (where.Op == "<=") {
+		first = tree.begin();
+		last = tree.upper_bound(low);
+	}
+	else if (where.Op == ">") {
+		first = tree.upper_bound(low);
+		last = tree.end();
+	}
+	else if (where.Op == ">=") {
+		first = tree.lower_bound(low);
+		last = tree.end();
+	}
+	else if (where.Op == "between") {
+		if (high < low) { // empty range
+			return matches;
+		}
+		first = tree.lower_bound(low);
+		last = tree.upper_bound(high);
+	}
+	else if (where.Op == "like") {
+		if constexpr (is_same<TKey, fieldkey>::value) {
+			// keys with the prefix are contiguous, starting at lower_bound(prefix)
+			for (first = tree.lower_bound(fieldkey(likePrefix(where))); first != tree.end(); ++first) {
+				if (!where.matches(first.key())) {
+					break;
+				}
+				matches.insert(matches.end(), first.value().begin(), first.value().end());
+			}
+		}
+		return matches;
+	}
+
+	for (; first != last; ++first) {
+		matches.insert(matches.end(), first.value().begin(), first.value().end());
+	}
+	return matches;
+
+}
+
+
+// avlSearch on the index's tree, whichever key type it has
+vector<streamoff> IndexSearch(const keyindex& index, const predicate& where) {
+
+	return index.visit([&](const auto& tree) {	return avlSearch(tree, where);	});
+
+}
+
+
+// the run of sorted ranks [first, last) of a frozen index's keys that
+// satisfy the where clause.  Keys are EncodeKey's bytes, so the clause's
+// are searched for.
+void IndexRange(const flatindex& index, const predicate& where, size_t& first, size_t& last) {
+
+	first = 0;
+	last = 0;
+
+	if (!where.Valid || (where.Op == "like" && where.Type != columnfile::String)) {
+		return;
+	}
+	else if (where.Op == "=") {
+		first = index.lower_bound(where.Key);
+		last = index.upper_bound(where.Key);
+	}
+	else if (where.Op == "<") {
+		first = 0;
+		last = index.lower_bound(where.Key);
+	}
+	else if (where.Op == "<=") {
+		first = 0;
+		last = index.upper_bound(where.Key);
+	}
+	else if (where.Op == ">") {
+		first = index.upper_bound(where.Key);
+		last = index.size();
+	}
+	else if (where.Op == ">=") {
+		first = index.lower_bound(where.Key);
+		last = index.size();
+	}
+	else if (where.Op == "between") {
+		if (!(where.Key2 < where.Key)) { // else empty range
+			first = index.lower_bound(where.Key);
+			last = index.upper_bound(where.Key2);
+		}
+	}
+	else if (where.Op == "like") {
+		// keys with the prefix are contiguous, starting at lower_bound(prefix)
+		first = index.lower_bound(likePrefix(where));
+		last = first;
+		while (last < index.size() && where.matches(index.key(last))) {
+			last++;
+		}
+	}
+
+}
+
+
+// same as IndexSearch above, over a frozen index: the matching keys are
+// a run of sorted ranks (see IndexRange), so their positions are one
+// contiguous range.
+vector<streamoff> IndexSearch(const flatindex& index, const predicate& where) {
+
+	size_t first, last;
+	IndexRange(index, where, first, last);
+	positionrange range = index.positions(first, last);
+	return vector<streamoff>(range.begin(), range.end());
+
+}
+
+
+// same as IndexSearch above, over a disk-resident B+tree: the matching
+// entries are one run of leaf entries, read in order a page at a time.
+vector<streamoff> IndexSearch(const btree& tree, const predicate& where) {
+
+	vector<streamoff> matches;
+	btree::iterator   first, last;
+
+	if (!where.Valid || (where.Op == "like" && where.Type != columnfile::String)) {
+		return matches;
+	}
+	else if (where.Op == "=") {
+		first = tree.lower_bound(where.Key);
+		last = tree.upper_bound(where.Key);
+	}
+	else if (where.Op == "<") {
+		first = tree.begin();
+		last = tree.lower_bound(where.Key);
+	}
+	else if (where.Op == "<=") {
+		first = tree.begin();
+		last = tree.upper_bound(where.Key);
+	}
+	else if (where.Op == ">") {
+		first = tree.upper_bound(where.Key);
+		last = tree.end();
+	}
+	else if (where.Op == ">=") {
+		first = tree.lower_bound(where.Key);
+		last = tree.end();
+	}
+	else if (where.Op == "between") {
+		if (where.Key2 < where.Key) { // empty range
+			return matches;
+		}
+		first = tree.lower_bound(where.Key);
+		last = tree.upper_bound(where.Key2);
+	}
+	else if (where.Op == "like") {
+		// keys with the prefix are contiguous, starting at lower_bound(prefix)
+		for (first = tree.lower_bound(likePrefix(where)); first != tree.end(); ++first) {
+			if (!where.matches(first.key())) {
+				break;
+			}
+			matches.push_back(first.value());
+		}
+		return matches;
+	}
+
+	for (; first != last; ++first) {
+		matches.push_back(first.value());
+	}
+	return matches;
+
+}
+
+
+// FNV-1a, 8 bytes at a time, with the high bits folded back down each
+// step so every byte reaches every bit of the hash
+static inline uint64_t hashWord(uint64_t hash, uint64_t word) {
+
+	hash = (hash ^ word) * 1099511628211ull;
+	return hash ^ (hash >> 32);
+
+}
+
+
+// hashes each of blocks (block numbers, ChecksumBlock bytes each, the
+// last one shorter) of the .data file into hashes[block], which must
+// be big enough.  Given a worker pool, the blocks are hashed in parallel.
+void BlockChecksums(const datafile& table, const vector<size_t>& blocks, vector<uint64_t>& hashes, workerpool* pool) {
+
+	auto hashBlock = [&](int b) {
+		size_t block = blocks[b];
+		streamoff first = (streamoff) block * ChecksumBlock;
+		streamoff last = min(first + ChecksumBlock, table.length());
+		const char* data = table.data();
+		uint64_t hash = 14695981039346656037ull;
+		streamoff i = first;
+		for (; i + 8 <= last; i += 8) {
+			uint64_t word;
+			memcpy(&word, data + i, 8);
+			hash = hashWord(hash, word);
+		}
+		for (; i < last; i++) {
+			hash = hashWord(hash, (unsigned char) data[i]);
+		}
+		hashes[block] = hash;
+	};
+	if (pool != nullptr && pool->size() > 1 && blocks.size() > 1) {
+		pool->parallel_for(blocks.size(), hashBlock);
+	}
+	else {
+		for (size_t b = 0; b < blocks.size(); b++) {
+			hashBlock(b);
+		}
+	}
+
+}
+
+
+// the .data file's checksum, from the hashes of all of its blocks
+uint64_t Checksum(const datafile& table, const vector<uint64_t>& hashes) {
+
+	uint64_t hash = hashWord(14695981039346656037ull, table.length());
+	for (uint64_t blockHash : hashes) {
+		hash = hashWord(hash, blockHash);
+	}
+	return hash;
+
+}
+
+
+// hash of the entire .data file, from the hashes of its blocks.  Stored
+// in each index file so an index built from different data is never
+// loaded.
+uint64_t Checksum(const datafile& table, workerpool* pool) {
+
+	vector<size_t> blocks((table.length() + ChecksumBlock - 1) / ChecksumBlock);
+	iota(blocks.begin(), blocks.end(), 0);
+	vector<uint64_t> hashes(blocks.size());
+	BlockChecksums(table, blocks, hashes, pool);
+	return Checksum(table, hashes);
+
+}
+
+
+// header at the start of every .idx file; ties the index to one
+// version of the .data file.
+struct IndexHeader {
+	char     Magic[8];
+	int64_t  Length;    // size of .data file when index was built
+	int64_t  ModTime;   // mtime of .data file when index was built
+	uint64_t Checksum;  // Checksum() of .data file when index was built
+	uint64_t Count;     // # of key/posting list entries that follow
+	int64_t  KeyType;   // keyindex::type() of the index
+};
+
+static const char IndexMagic[8] = {'m', 'y', 'D', 'B', 'i', 'd', 'x', '3'};
+
+
+// writes the index's keys and values (inorder) to an index file: the
+// header, then per entry a 4-byte key length, the key bytes (as
+// EncodeKey makes them), a 4-byte count and that many 8-byte file
+// positions.  Written to a temp file then renamed, so a crash never
+// leaves a half-written index behind.
+bool SaveIndex(string filename, const datafile& table, uint64_t checksum, const keyindex& index) {
+
+	IndexHeader header;
+	copy(IndexMagic, IndexMagic + 8, header.Magic);
+	header.Length = table.length();
+	header.ModTime = table.modTime();
+	header.Checksum = checksum;
+	header.Count = index.size();
+	header.KeyType = index.type();
+
+	string   tempname = filename + ".tmp";
+	ofstream out(tempname, ios::out | ios::binary | ios::trunc);
+	if (!out.good()) {
+		return false;
+	}
+	out.write((const char*) &header, sizeof(header));
+	index.visit([&](const auto& tree) {
+		for (auto it = tree.begin(); it != tree.end(); ++it) {
+			auto&& key = EncodeKey(it.key());
+			uint32_t keyLength = key.size();
+			uint32_t count = it.value().size();
+			out.write((const char*) &keyLength, sizeof(keyLength));
+			out.write(key.data(), keyLength);
+			out.write((const char*) &count, sizeof(count));
+			for (streamoff pos : it.value()) {
+				int64_t value = pos;
+				out.write((const char*) &value, sizeof(value));
+			}
+		}
+	});
+	out.close();
+	if (!out.good() || rename(tempname.c_str(), filename.c_str()) != 0) {
+		remove(tempname.c_str());
+		return false;
+	}
+	return true;
+
+}
+
+
+// loads an index saved by SaveIndex into index, which must have been
+// made with the key type it was saved with.  Returns false, leaving the
+// index empty, if the file is missing, corrupt, of another key type, or
+// was built from a different version of the .data file --- the caller
+// then rebuilds.  String keys are made views of their first record.
+bool LoadIndex(string filename, const datafile& table, uint64_t checksum, keyindex& index) {
+
+	index = keyindex(index.type());
+	ifstream in(filename, ios::in | ios::binary);
+	if (!in.good()) {
+		return false;
+	}
+
+	IndexHeader header;
+	in.read((char*) &header, sizeof(header));
+	if (!in.good() || !equal(IndexMagic, IndexMagic + 8, header.Magic) ||
+		header.Length != table.length() || header.ModTime != table.modTime() ||
+		header.Checksum != checksum || header.KeyType != index.type()) {
+		return false;
+	}
+
+	return index.visit([&](auto& tree) {
+		// entries were saved inorder, so they can be bulk loaded as is
+		typedef typename remove_reference<decltype(tree)>::type::key_type TKey;
+		vector<pair<TKey, postinglist>> pairs;
+		pairs.reserve(header.Count);
+		string bytes;
+		TKey key;
+		for (uint64_t i = 0; i < header.Count; i++) {
+			uint32_t keyLength, count;
+			in.read((char*) &keyLength, sizeof(keyLength));
+			if (!in.good() || keyLength > (uint64_t) table.length()) {
+				return false;
+			}
+			bytes.resize(keyLength);
+			in.read(&bytes[0], keyLength);
+			in.read((char*) &count, sizeof(count));
+			if (!in.good() || count == 0 || count > (uint64_t) table.length()) {
+				return false;
+			}
+			postinglist postings;
+			for (uint32_t j = 0; j < count; j++) {
+				int64_t value;
+				in.read((char*) &value, sizeof(value));
+				postings.push_back(value);
+			}
+			if (!in.good()) {
+				return false;
+			}
+			if constexpr (is_same<TKey, fieldkey>::value) {
+				if (!recordKey(table, *postings.begin(), bytes, key)) { // keys view the .data file
+					return false;
+				}
+			}
+			else {
+				DecodeKey(bytes, key);
+			}
+			pairs.push_back(make_pair(key, std::move(postings)));
+		}
+		tree.bulkload(pairs);
+		return true;
+	});
+
+}
+
+
+// .col file layout: the header, one COLUMNENTRY per column, then each
+// column's arrays, every array starting on an 8 byte boundary.  A string
+// column is NumRows uint32 codes at Offset, and at DictOffset DictSize+1
+// uint32 starts followed by the sorted distinct values back to back.
+struct ColumnHeader {
+	char    Magic[8];
+	int64_t NumRows;
+	int64_t NumColumns;
+	int64_t Length;   // size of .data file when converted
+	int64_t ModTime;  // mtime of .data file when converted
+};
+
+struct ColumnEntry {
+	int64_t Type;
+	int64_t Offset;
+	int64_t DictSize;
+	int64_t DictOffset;
+};
+
+static const char ColumnMagic[8] = {'m', 'y', 'D', 'B', 'c', 'o', 'l', '1'};
+
+
+// the type code for a .meta column type: "string", "int" or "double";
+// -1 if unknown
+int ColumnType(string_view name) {
+
+	if (name == "string") {
+		return columnfile::String;
+	}
+	else if (name == "int") {
+		return columnfile::Int;
+	}
+	else if (name == "double") {
+		return columnfile::Double;
+	}
+	return -1;
+
+}
+
+
+// parses all of text as a number; false if it isn't one
+template<typename T>
+static bool parseNumber(string_view text, T& value) {
+
+	const char* end = text.data() + text.size();
+	from_chars_result result = from_chars(text.data(), end, value);
+	return result.ec == errc() && result.ptr == end;
+
+}
+
+
+// pads out to the next 8 byte boundary
+static void align8(ofstream& out) {
+
+	static const char zeros[8] = {};
+	streamoff pos = out.tellp();
+	out.write(zeros, (8 - pos % 8) % 8);
+
+}
+
+
+// converts a mapped .data file into a .col file, with one column of
+// the given type (ColumnType codes) per column.  Values of int and
+// double columns must parse as such; the first that doesn't is written
+// to errors and nothing is saved.  Written to a temp file then renamed.
+bool SaveColumns(string filename, const datafile& table, const vector<int>& types, ostream& errors) {
+
+	int64_t numRows = (table.recordSize() > 0) ? table.length() / table.recordSize() : 0;
+	int numColumns = types.size();
+
+	// parse every column first, so a bad value leaves no file behind
+	vector<vector<int64_t>>  ints(numColumns);
+	vector<vector<double>>   doubles(numColumns);
+	vector<vector<uint32_t>> codes(numColumns);
+	vector<vector<string_view>> strings(numColumns);  // string columns' values, then their dictionaries
+
+	vector<string_view> values;
+	for (int c = 0; c < numColumns; c++) {
+		if (types[c] == columnfile::Int) {
+			ints[c].resize(numRows);
+		}
+		else if (types[c] == columnfile::Double) {
+			doubles[c].resize(numRows);
+		}
+		else {
+			strings[c].resize(numRows);
+		}
+	}
+	for (int64_t row = 0; row < numRows; row++) {
+		GetRecord(table, row * table.recordSize(), values);
+		values.resize(numColumns);
+		for (int c = 0; c < numColumns; c++) {
+			bool parsed = true;
+			if (types[c] == columnfile::Int) {
+				parsed = parseNumber(values[c], ints[c][row]);
+			}
+			else if (types[c] == columnfile::Double) {
+				parsed = parseNumber(values[c], doubles[c][row]);
+			}
+			else {
+				strings[c][row] = values[c];
+			}
+			if (!parsed) {
+				errors << "**Error: record " << row << ", column " << c + 1 << ": '" << values[c]
+				<< "' is not " << (types[c] == columnfile::Int ? "an int" : "a double") << "." << endl;
+				return false;
+			}
+		}
+	}
+
+	// dictionaries: the sorted distinct values, and every record's code
+	for (int c = 0; c < numColumns; c++) {
+		if (types[c] != columnfile::String) {
+			continue;
+		}
+		vector<string_view> dict = strings[c];
+		sort(dict.begin(), dict.end());
+		dict.erase(unique(dict.begin(), dict.end()), dict.end());
+		codes[c].resize(numRows);
+		for (int64_t row = 0; row < numRows; row++) {
+			codes[c][row] = lower_bound(dict.begin(), dict.end(), strings[c][row]) - dict.begin();
+		}
+		strings[c].swap(dict);
+	}
+
+	string   tempname = filename + ".tmp";
+	ofstream out(tempname, ios::out | ios::binary | ios::trunc);
+	if (!out.good()) {
+		errors << "**Error: couldn't create column file '" << filename << "'." << endl;
+		return false;
+	}
+
+	ColumnHeader header;
+	copy(ColumnMagic, ColumnMagic + 8, header.Magic);
+	header.NumRows = numRows;
+	header.NumColumns = numColumns;
+	header.Length = table.length();
+	header.ModTime = table.modTime();
+	out.write((const char*) &header, sizeof(header));
+
+	// the directory is written once the offsets are known
+	vector<ColumnEntry> entries(numColumns);
+	streamoff directory = out.tellp();
+	out.write((const char*) entries.data(), numColumns * sizeof(ColumnEntry));
+
+	for (int c = 0; c < numColumns; c++) {
+		align8(out);
+		entries[c].Type = types[c];
+		entries[c].Offset = out.tellp();
+		entries[c].DictSize = 0;
+		entries[c].DictOffset = 0;
+		if (types[c] == columnfile::Int) {
+			out.write((const char*) ints[c].data(), numRows * sizeof(int64_t));
+		}
+		else if (types[c] == columnfile::Double) {
+			out.write((const char*) doubles[c].data(), numRows * sizeof(double));
+		}
+		else {
+			out.write((const char*) codes[c].data(), numRows * sizeof(uint32_t));
+			align8(out);
+			entries[c].DictSize = strings[c].size();
+			entries[c].DictOffset = out.tellp();
+			uint32_t start = 0;
+			for (string_view value : strings[c]) {
+				out.write((const char*) &start, sizeof(start));
+				start += value.size();
+			}
+			out.write((const char*) &start, sizeof(start));
+			for (string_view value : strings[c]) {
+				out.write(value.data(), value.size());
+			}
+		}
+	}
+	out.seekp(directory);
+	out.write((const char*) entries.data(), numColumns * sizeof(ColumnEntry));
+	out.close();
+
+	if (!out.good() || rename(tempname.c_str(), filename.c_str()) != 0) {
+		remove(tempname.c_str());
+		errors << "**Error: couldn't write column file '" << filename << "'." << endl;
+		return false;
+	}
+	return true;
+
+}
+
+
+columnfile::columnfile() {
+
+	Data = nullptr;
+	Length = 0;
+	NumRows = 0;
+
+}
+
+
+columnfile::~columnfile() {
+
+	close();
+
+}
+
+
+// maps "tablename.col".  Returns false if there is none, or it wasn't
+// converted from this .data file or with these column types --- it is
+// then out of date, and ignored.
+bool columnfile::open(string tablename, const datafile& table, const vector<int>& types) {
+
+	close();
+	string filename = tablename + ".col";
+	int fd = ::open(filename.c_str(), O_RDONLY);
+	struct stat info;
+	if (fd < 0) {
+		return false;
+	}
+	if (fstat(fd, &info) != 0 || info.st_size < (off_t) sizeof(ColumnHeader)) {
+		::close(fd);
+		return false;
+	}
+	void* mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (mapping == MAP_FAILED) {
+		return false;
+	}
+	Data = (const char*) mapping;
+	Length = info.st_size;
+
+	const ColumnHeader* header = (const ColumnHeader*) Data;
+	if (!equal(ColumnMagic, ColumnMagic + 8, header->Magic) ||
+		header->Length != table.length() || header->ModTime != table.modTime() ||
+		header->NumColumns != (int64_t) types.size() ||
+		sizeof(ColumnHeader) + types.size() * sizeof(ColumnEntry) > Length) {
+		close();
+		return false;
+	}
+	NumRows = header->NumRows;
+
+	const ColumnEntry* entries = (const ColumnEntry*) (Data + sizeof(ColumnHeader));
+	for (size_t c = 0; c < types.size(); c++) {
+		if (entries[c].Type != types[c]) {
+			close();
+			return false;
+		}
+		COLUMN column;
+		column.Type = entries[c].Type;
+		column.Values = Data + entries[c].Offset;
+		column.DictSize = entries[c].DictSize;
+		column.DictStart = (const uint32_t*) (Data + entries[c].DictOffset);
+		column.DictBytes = (const char*) (column.DictStart + column.DictSize + 1);
+		Columns.push_back(column);
+	}
+	return true;
+
+}
+
+
+// unmaps the file; safe to call more than once.
+void columnfile::close() {
+
+	if (Data != nullptr) {
+		munmap((void*) Data, Length);
+	}
+	Data = nullptr;
+	Length = 0;
+	NumRows = 0;
+	Columns.clear();
+
+}
+
+
+// the rows of values[0..rows) that satisfy the where clause, compared
+// as numbers.  A value that isn't a number matches nothing.
+template<typename T>
+static void scanNumbers(const T* values, int64_t rows, const predicate& where, int recordSize, vector<streamoff>& matches) {
+
+	T low, high;
+	if (!parseNumber(where.Value, low) || (where.Op == "between" && !parseNumber(where.Value2, high))) {
+		return;
+	}
+
+	// one tight loop per operator, so the compiler can vectorize the test
+	auto scan = [&](auto test) {
+		for (int64_t row = 0; row < rows; row++) {
+			if (test(values[row])) {
+				matches.push_back((streamoff) row * recordSize);
+			}
+		}
+	};
+	if (where.Op == "=") {
+		scan([low](T v) { return v == low; });
+	}
+	else if (where.Op == "<") {
+		scan([low](T v) { return v < low; });
+	}
+	else if (where.Op == "<=") {
+		scan([low](T v) { return v <= low; });
+	}
+	else if (where.Op == ">") {
+		scan([low](T v) { return v > low; });
+	}
+	else if (where.Op == ">=") {
+		scan([low](T v) { return v >= low; });
+	}
+	else if (where.Op == "between") {
+		scan([low, high](T v) { return (v >= low) & (v <= high); });
+	}
+
+}
+
+
+// same as LinearSearch, over the typed column file: finds the records
+// whose column (0-based) satisfies the where clause and adds their .data
+// positions to matches, in file order.  Only that column is read.  int
+// and double columns are compared as numbers; string columns test each
+// distinct value once and then only compare codes.  Returns false if
+// the column file can't answer the clause (like on a number column).
+bool ColumnSearch(const columnfile& columns, const predicate& where, int column, int recordSize, vector<streamoff>& matches) {
+
+	int64_t rows = columns.numRows();
+	int type = columns.type(column);
+	if (type != columnfile::String && where.Op == "like") {
+		return false;
+	}
+	CountStat(&querystats::RecordsScanned, rows);
+	CountStat(&querystats::BytesRead, rows * (type == columnfile::String ? sizeof(uint32_t) : 8));
+
+	if (type == columnfile::Int) {
+		scanNumbers(columns.ints(column), rows, where, recordSize, matches);
+		return true;
+	}
+	else if (type == columnfile::Double) {
+		scanNumbers(columns.doubles(column), rows, where, recordSize, matches);
+		return true;
+	}
+
+	vector<unsigned char> hit(columns.dictSize(column));
+	bool any = false;
+	for (int64_t code = 0; code < columns.dictSize(column); code++) {
+		hit[code] = where.matches(columns.dictValue(column, code));
+		any = any || hit[code];
+	}
+	if (!any) {
+		return true;
+	}
+	const uint32_t* codes = columns.codes(column);
+	for (int64_t row = 0; row < rows; row++) {
+		if (hit[codes[row]]) {
+			matches.push_back((streamoff) row * recordSize);
+		}
+	}
+	return true;
+
+}
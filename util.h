@@ -1,10 +1,232 @@
+#ifndef UTIL_H
+#define UTIL_H
+
 #include <iostream>
 #include <fstream>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <sstream>
+#include <cstdint>
+#include <variant>
+#include <functional>
+#include "avl.h"
+#include "postings.h"
+#include "keys.h"
+#include "flatindex.h"
+#include "hashindex.h"
+#include "btree.h"
+#include "workerpool.h"
 using namespace std;
 
 void EchoData(string tablename, int recordSize, int numColumns);
 vector<string> GetRecord(string tablename, streamoff pos, int numColumns);
-vector<streamoff> LinearSearch(string tablename, int recordSize, int numColumns, string matchValue, int matchColumn);
\ No newline at end of file
+vector<streamoff> LinearSearch(string tablename, int recordSize, int numColumns, string matchValue, int matchColumn);
+
+
+// Read-only handle to a table's .data file.  The file is mapped
+// into memory once by open(), and records are then read straight
+// out of the mapping as string_views --- no file I/O, no copies.
+// The file is written through a writelog, which only appends records
+// and sets tombstones; refresh() then picks up its new length.  The
+// mapping is made larger than the file, so appends seldom move it.
+class datafile {
+
+public:
+
+	// a deleted record has this byte in place of the one before its
+	// \r\n: the last padding byte, or the space after its last value
+	static const char Tombstone = '#';
+
+private:
+
+	string      FileName;
+	const char* Data;        // start of mapping (nullptr if empty or closed)
+	streamoff   Length;      // # of bytes in the .data file
+	size_t      Mapped;      // # of bytes mapped, at least Length
+	int64_t     ModTime;     // last modification time of the .data file
+	int         RecordSize;  // fixed size of one record, from .meta
+	int         NumColumns;  // # of values per record, from .meta
+
+	bool _map(int fd);
+
+public:
+
+	datafile();
+	datafile(const datafile& other) = delete;
+	datafile& operator=(const datafile& other) = delete;
+	~datafile();
+
+	bool open(string tablename, int recordSize, int numColumns);
+	bool refresh(bool reopen = false);
+	void close();
+
+	const char* data() const     {	return Data;	}
+	streamoff   length() const   {	return Length;	}
+	int         recordSize() const {	return RecordSize;	}
+	int         numColumns() const {	return NumColumns;	}
+	int64_t     modTime() const    {	return ModTime;	}
+
+	// true if the record at pos has been deleted
+	bool deleted(streamoff pos) const {
+		streamoff mark = pos + RecordSize - 3;
+		return mark >= 0 && mark < Length && Data[mark] == Tombstone;
+	}
+
+};
+
+// Read-only handle to a table's .col file: the same records as its
+// .data file, converted by import.exe to one typed array per column.
+// int and double columns are arrays of int64 / double values; string
+// columns are dictionary encoded, as a sorted array of their distinct
+// values plus one uint32 code per record.  A scan of one column reads
+// only that column's array.
+class columnfile {
+
+public:
+
+	static const int String = 0;  // column types, as stored in the file
+	static const int Int = 1;
+	static const int Double = 2;
+
+private:
+
+	struct COLUMN {
+		int             Type;
+		const char*     Values;     // NumRows int64s, doubles or uint32 codes
+		int64_t         DictSize;   // string columns: # of distinct values
+		const uint32_t* DictStart;  // string columns: code -> start of value in DictBytes; [DictSize] is the end
+		const char*     DictBytes;
+	};
+
+	const char*    Data;     // start of mapping (nullptr if closed)
+	size_t         Length;   // # of bytes in the .col file
+	int64_t        NumRows;
+	vector<COLUMN> Columns;
+
+public:
+
+	columnfile();
+	columnfile(const columnfile& other) = delete;
+	columnfile& operator=(const columnfile& other) = delete;
+	~columnfile();
+
+	bool open(string tablename, const datafile& table, const vector<int>& types);
+	void close();
+
+	bool    isOpen() const    {	return Data != nullptr;	}
+	size_t  length() const    {	return Length;	}
+	int64_t numRows() const   {	return NumRows;	}
+	int     type(int column) const  {	return Columns[column].Type;	}
+
+	const int64_t*  ints(int column) const     {	return (const int64_t*) Columns[column].Values;	}
+	const double*   doubles(int column) const  {	return (const double*) Columns[column].Values;	}
+	const uint32_t* codes(int column) const    {	return (const uint32_t*) Columns[column].Values;	}
+	int64_t dictSize(int column) const  {	return Columns[column].DictSize;	}
+
+	string_view dictValue(int column, uint32_t code) const {
+		const COLUMN& c = Columns[column];
+		return string_view(c.DictBytes + c.DictStart[code], c.DictStart[code + 1] - c.DictStart[code]);
+	}
+
+};
+
+// A where clause on one column: "column Op Value", where Op is one of
+// = < <= > >= like, or "column between Value and Value2".  prepare()
+// gives it the column's type: values of int and double columns are
+// compared as numbers, the same order their indexes keep their keys in,
+// and string columns' values as strings.  A value that isn't a number
+// matches nothing in a number column (Valid is false).  like matches a
+// prefix of the text, of any column: "like abc%" is every value
+// starting with abc.
+struct predicate {
+
+	string Op;
+	string Value;
+	string Value2;  // upper bound, between only
+
+	int     Type;         // the column's type (columnfile::String, Int, Double)
+	bool    Valid;        // false if Value or Value2 isn't of that type
+	string  Key, Key2;    // Value, Value2 as index keys (see EncodeKey)
+	int64_t IntValue, IntValue2;
+	double  DoubleValue, DoubleValue2;
+
+	predicate() : Type(columnfile::String), Valid(true), IntValue(0), IntValue2(0), DoubleValue(0), DoubleValue2(0) {}
+
+	void prepare(int type);
+	bool matches(string_view value) const;
+
+};
+
+string_view FieldAt(const char* data, streamoff pos, streamoff end, int column);
+void EchoData(const datafile& table);
+void GetRecord(const datafile& table, streamoff pos, vector<string_view>& values);
+bool FormatRecord(const vector<string>& values, int recordSize, string& record);
+vector<streamoff> LinearSearch(const datafile& table, string_view matchValue, int matchColumn);
+vector<streamoff> LinearSearch(const datafile& table, const predicate& where, int matchColumn, workerpool* pool = nullptr);
+vector<streamoff> LinearSearch(const datafile& table, const function<bool(streamoff, streamoff)>& test, workerpool* pool = nullptr);
+
+// An index over one column: column value -> positions of every record
+// with that value.  Keys have the column's type: an int or double
+// column is indexed by int64_t or double keys, in numeric order, and a
+// string column by fieldkeys, views of its values in the mapped .data
+// file, so the tree holds no copy of them.  Which avl tree it holds is
+// fixed when it is made; visit() calls a function with the tree, so code
+// that walks the keys is compiled once per key type.  insert() and
+// erase() take a value as it is in the .data file, and skip one that
+// isn't of the key type --- no where clause can match it either.
+//
+// A fieldkey always views the value in one of its own records, which
+// stay mapped as long as they aren't deleted: erase() moves the view to
+// another record of the key when it deletes the one it was in, and
+// rebase() moves every view when the mapping moves.
+class keyindex {
+
+private:
+
+	// alternative i is the tree for columnfile type i
+	variant<avltree<fieldkey, postinglist>, avltree<int64_t, postinglist>, avltree<double, postinglist>> Tree;
+
+public:
+
+	explicit keyindex(int type = columnfile::String);
+
+	int type() const  {	return (int) Tree.index();	}
+
+	template<typename Fn>
+	auto visit(Fn fn)        {	return std::visit(fn, Tree);	}
+	template<typename Fn>
+	auto visit(Fn fn) const  {	return std::visit(fn, Tree);	}
+
+	int  size() const    {	return visit([](const auto& tree) {	return tree.size();	});	}
+	int  height() const  {	return visit([](const auto& tree) {	return tree.height();	});	}
+
+	bool insert(string_view value, streamoff pos);
+	bool erase(string_view value, streamoff pos, const datafile& data);
+	void thaw(const hashindex& hash, const datafile& data);
+	void rebase(const char* from, const char* to, const function<streamoff(streamoff)>& moved);
+
+};
+
+bool IndexKey(int type, string_view value, string& key);
+
+vector<streamoff> IndexSearch(const keyindex& index, const predicate& where);
+void IndexRange(const flatindex& index, const predicate& where, size_t& first, size_t& last);
+vector<streamoff> IndexSearch(const flatindex& index, const predicate& where);
+vector<streamoff> IndexSearch(const btree& tree, const predicate& where);
+
+int ColumnType(string_view name);
+bool SaveColumns(string filename, const datafile& table, const vector<int>& types, ostream& errors);
+bool ColumnSearch(const columnfile& columns, const predicate& where, int column, int recordSize, vector<streamoff>& matches);
+
+// The checksum of a .data file is made from the hashes of its blocks of
+// ChecksumBlock bytes, so the blocks can be hashed in parallel, and
+// after a write only the blocks it changed need hashing again.
+const streamoff ChecksumBlock = 1 << 20;
+void BlockChecksums(const datafile& table, const vector<size_t>& blocks, vector<uint64_t>& hashes, workerpool* pool = nullptr);
+uint64_t Checksum(const datafile& table, const vector<uint64_t>& hashes);
+uint64_t Checksum(const datafile& table, workerpool* pool = nullptr);
+bool SaveIndex(string filename, const datafile& table, uint64_t checksum, const keyindex& index);
+bool LoadIndex(string filename, const datafile& table, uint64_t checksum, keyindex& index);
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+using namespace std;
+
+
+// A fixed set of worker threads fed from one task queue.  Threads are
+// started once, by the constructor, and reused for every task; the
+// destructor finishes the queued tasks and joins them.
+class workerpool {
+
+private:
+
+	vector<thread>          Workers;
+	queue<function<void()>> Tasks;
+	mutex                   Lock;
+	condition_variable      Ready;  // signalled when a task is queued or on shutdown
+	bool                    Stopping;
+
+
+	// each worker runs tasks until the pool is destroyed
+	void _work() {
+
+		while (true) {
+			function<void()> task;
+			{
+				unique_lock<mutex> guard(Lock);
+				Ready.wait(guard, [this]() { return Stopping || !Tasks.empty(); });
+				if (Tasks.empty()) { // stopping, and nothing left to do
+					return;
+				}
+				task = std::move(Tasks.front());
+				Tasks.pop();
+			}
+			task();
+		}
+
+	}
+
+public:
+
+	explicit workerpool(int numThreads) {
+
+		Stopping = false;
+		for (int i = 0; i < numThreads; i++) {
+			Workers.emplace_back(&workerpool::_work, this);
+		}
+
+	}
+
+	workerpool(const workerpool& other) = delete;
+	workerpool& operator=(const workerpool& other) = delete;
+
+
+	~workerpool() {
+
+		{
+			lock_guard<mutex> guard(Lock);
+			Stopping = true;
+		}
+		Ready.notify_all();
+		for (thread& worker : Workers) {
+			worker.join();
+		}
+
+	}
+
+
+	int size() const {	return Workers.size();	}
+
+
+	// queues a task to run on some worker, and returns right away.
+	void submit(function<void()> task) {
+
+		{
+			lock_guard<mutex> guard(Lock);
+			Tasks.push(std::move(task));
+		}
+		Ready.notify_one();
+
+	}
+
+
+	// runs task(0), task(1), ... task(count-1) on the workers and waits
+	// for all of them to finish.
+	void parallel_for(int count, const function<void(int)>& task) {
+
+		mutex              doneLock;
+		condition_variable allDone;
+		int                remaining = count;
+
+		for (int i = 0; i < count; i++) {
+			submit([&, i]() {
+				task(i);
+				lock_guard<mutex> guard(doneLock);
+				if (--remaining == 0) {
+					allDone.notify_one();
+				}
+			});
+		}
+		unique_lock<mutex> guard(doneLock);
+		allDone.wait(guard, [&]() { return remaining == 0; });
+
+	}
+
+};
+
+#endif
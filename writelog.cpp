@@ -0,0 +1,273 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include "writelog.h"
+#include "util.h"
+using namespace std;
+
+
+// Log layout: entries back to back, each a header and then Size bytes
+// of payload.  A write is its appends and tombstones followed by a
+// commit; only committed writes are replayed.
+struct LogEntry {
+	uint32_t Type;      // one of the entry types below
+	uint32_t Size;      // payload bytes: the record for appends, else 0
+	int64_t  Pos;       // .data position of the record
+	uint64_t Checksum;  // of the other fields and the payload
+};
+
+static const uint32_t AppendEntry = 1;
+static const uint32_t TombstoneEntry = 2;
+static const uint32_t CommitEntry = 3;
+
+
+// FNV-1a over an entry's fields and payload
+static uint64_t entryChecksum(const LogEntry& entry, const char* payload) {
+
+	uint64_t hash = 14695981039346656037ull;
+	auto add = [&](const void* p, size_t n) {
+		for (size_t i = 0; i < n; i++) {
+			hash = (hash ^ ((const unsigned char*) p)[i]) * 1099511628211ull;
+		}
+	};
+	add(&entry.Type, sizeof(entry.Type));
+	add(&entry.Size, sizeof(entry.Size));
+	add(&entry.Pos, sizeof(entry.Pos));
+	add(payload, entry.Size);
+	return hash;
+
+}
+
+
+// appends one entry to buffer
+static void addEntry(string& buffer, uint32_t type, streamoff pos, const string& payload) {
+
+	LogEntry entry;
+	entry.Type = type;
+	entry.Size = payload.size();
+	entry.Pos = pos;
+	entry.Checksum = entryChecksum(entry, payload.data());
+	buffer.append((const char*) &entry, sizeof(entry));
+	buffer.append(payload);
+
+}
+
+
+// writes all of buffer at offset; false on any error
+static bool writeAll(int fd, const string& buffer, off_t offset) {
+
+	size_t written = 0;
+	while (written < buffer.size()) {
+		ssize_t n = pwrite(fd, buffer.data() + written, buffer.size() - written, offset + written);
+		if (n <= 0) {
+			return false;
+		}
+		written += n;
+	}
+	return true;
+
+}
+
+
+writelog::writelog() {
+
+	DataFile = -1;
+	LogFile = -1;
+	RecordSize = 0;
+	LogSize = 0;
+	Sync = true;
+
+}
+
+
+writelog::~writelog() {
+
+	close();
+
+}
+
+
+// opens "tablename.data" for writing and its log, replaying whatever the
+// log holds from a run that didn't checkpoint.  Returns false (and
+// outputs why) if either can't be opened, and the table is read-only.
+bool writelog::open(string tablename, int recordSize, ostream& errors) {
+
+	close();
+	DataName = tablename + ".data";
+	LogName = tablename + ".wal";
+	RecordSize = recordSize;
+	DataFile = ::open(DataName.c_str(), O_RDWR);
+	if (DataFile < 0) {
+		return false;
+	}
+	LogFile = ::open(LogName.c_str(), O_RDWR | O_CREAT, 0644);
+	if (LogFile < 0) {
+		errors << "**Error: couldn't open log file '" << LogName << "'." << endl;
+		close();
+		return false;
+	}
+	return _replay(errors);
+
+}
+
+
+// applies every committed write in the log to the .data file, then
+// checkpoints.  Stops at the first entry that is torn or corrupt.
+bool writelog::_replay(ostream& errors) {
+
+	off_t end = lseek(LogFile, 0, SEEK_END);
+	if (end <= 0) {
+		LogSize = 0;
+		return true;
+	}
+	string log(end, '\0');
+	if (pread(LogFile, &log[0], end, 0) != end) {
+		errors << "**Error: couldn't read log file '" << LogName << "'." << endl;
+		_release();
+		return false;
+	}
+
+	string tombstone(1, datafile::Tombstone);
+	vector<pair<const LogEntry*, const char*>> pending;  // entries of a write not yet committed
+	int applied = 0;
+	size_t offset = 0;
+	while (offset + sizeof(LogEntry) <= log.size()) {
+		const LogEntry* entry = (const LogEntry*) (log.data() + offset);
+		const char* payload = log.data() + offset + sizeof(LogEntry);
+		if (offset + sizeof(LogEntry) + entry->Size > log.size() ||
+				entry->Checksum != entryChecksum(*entry, payload)) {
+			break;
+		}
+		offset += sizeof(LogEntry) + entry->Size;
+		if (entry->Type != CommitEntry) {
+			pending.push_back(make_pair(entry, payload));
+			continue;
+		}
+		for (const pair<const LogEntry*, const char*>& p : pending) {
+			bool ok = (p.first->Type == AppendEntry) ?
+				writeAll(DataFile, string(p.second, p.first->Size), p.first->Pos) :
+				writeAll(DataFile, tombstone, p.first->Pos + RecordSize - 3);
+			if (!ok) {
+				errors << "**Error: couldn't replay log file '" << LogName << "'." << endl;
+				_release();
+				return false;
+			}
+		}
+		pending.clear();
+		applied++;
+	}
+	LogSize = end;
+	if (applied > 0) {
+		cout << "Replayed " << applied << " write(s) from " << LogName << endl;
+	}
+	return checkpoint();
+
+}
+
+
+// checkpoints, then closes both files.  The log is removed once it is
+// empty, so tables that were never written to don't keep one around.
+void writelog::close() {
+
+	if (DataFile >= 0 && LogFile >= 0 && checkpoint()) {
+		unlink(LogName.c_str());
+	}
+	_release();
+
+}
+
+
+// closes both files as they are, without a checkpoint, so a log whose
+// writes didn't all reach the .data file is kept for the next open.
+void writelog::_release() {
+
+	if (DataFile >= 0) {
+		::close(DataFile);
+	}
+	if (LogFile >= 0) {
+		::close(LogFile);
+	}
+	DataFile = -1;
+	LogFile = -1;
+	LogSize = 0;
+
+}
+
+
+// logs one write: tombstones for the records at deletes, and records,
+// each RecordSize bytes, appended at end (the .data file's length)
+// onwards.  Synced before returning, unless setSync(false).  Returns
+// false if the log couldn't be written, in which case it is as it was.
+bool writelog::write(const vector<streamoff>& deletes, const vector<string>& records, streamoff end) {
+
+	if (DataFile < 0) {
+		return false;
+	}
+	string buffer;
+	for (streamoff pos : deletes) {
+		addEntry(buffer, TombstoneEntry, pos, "");
+	}
+	for (size_t i = 0; i < records.size(); i++) {
+		addEntry(buffer, AppendEntry, end + (streamoff) i * RecordSize, records[i]);
+	}
+	addEntry(buffer, CommitEntry, 0, "");
+	if (!writeAll(LogFile, buffer, LogSize) || (Sync && fdatasync(LogFile) != 0)) {
+		ftruncate(LogFile, LogSize); // drop whatever part made it
+		return false;
+	}
+	LogSize += buffer.size();
+	return true;
+
+}
+
+
+// makes a logged write to the .data file.  Returns false if it failed
+// part way; the log has the write already, so replay() can finish it.
+bool writelog::apply(const vector<streamoff>& deletes, const vector<string>& records, streamoff end) {
+
+	string tombstone(1, datafile::Tombstone);
+	for (streamoff pos : deletes) {
+		if (!writeAll(DataFile, tombstone, pos + RecordSize - 3)) {
+			return false;
+		}
+	}
+	string appended;
+	for (const string& record : records) {
+		appended += record;
+	}
+	return writeAll(DataFile, appended, end);
+
+}
+
+
+// applies every committed write in the log to the .data file again,
+// e.g. after apply() failed, and checkpoints.  Returns false (and
+// outputs why) if that fails too; the files are then closed, the log
+// kept for the next open, and the table is read-only.
+bool writelog::replay(ostream& errors) {
+
+	if (DataFile < 0) {
+		return false;
+	}
+	return _replay(errors);
+
+}
+
+
+// syncs the .data file, after which the log's writes are no longer
+// needed and it is emptied.
+bool writelog::checkpoint() {
+
+	if (DataFile < 0 || LogSize == 0) {
+		return true;
+	}
+	if (fdatasync(DataFile) != 0 || ftruncate(LogFile, 0) != 0) {
+		return false;
+	}
+	LogSize = 0;
+	return true;
+
+}
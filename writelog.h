@@ -0,0 +1,54 @@
+#ifndef WRITELOG_H
+#define WRITELOG_H
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstdint>
+using namespace std;
+
+
+// Write-ahead log for a table's .data file.  Writes never change a
+// record in place: records are appended to the end of the file, and a
+// deleted record is marked with a tombstone, one byte before its \r\n
+// (see datafile::Tombstone).  write() appends each write to
+// "tablename.wal" as a group of entries ended by a commit entry and
+// syncs the log, and only then does apply() make it to the .data file,
+// so after a crash open() replays every committed write and drops a torn
+// last one.  The .data file itself is only synced by checkpoint(), which
+// then empties the log.
+class writelog {
+
+private:
+
+	string  DataName, LogName;
+	int     DataFile;    // .data, opened for writing; -1 if closed
+	int     LogFile;     // .wal; -1 if closed
+	int     RecordSize;
+	int64_t LogSize;     // bytes in the log
+	bool    Sync;        // sync the log on every write
+
+	bool _replay(ostream& errors);
+	void _release();
+
+public:
+
+	writelog();
+	writelog(const writelog& other) = delete;
+	writelog& operator=(const writelog& other) = delete;
+	~writelog();
+
+	bool open(string tablename, int recordSize, ostream& errors);
+	void close();
+	bool write(const vector<streamoff>& deletes, const vector<string>& records, streamoff end);
+	bool apply(const vector<streamoff>& deletes, const vector<string>& records, streamoff end);
+	bool replay(ostream& errors);
+	bool checkpoint();
+
+	bool    isOpen() const   {	return DataFile >= 0;	}
+	int64_t logSize() const  {	return LogSize;	}
+	void    setSync(bool sync)  {	Sync = sync;	}
+
+};
+
+#endif